@@ -0,0 +1,445 @@
+/**
+ * @file bench.cpp
+ * @copyright Copyright (c) 2023-present Ewan Robson.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "../yaml.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <sys/resource.h>
+#endif
+
+static std::atomic<std::size_t> s_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+struct BenchComponent
+{
+    std::vector<float> field0 = {};
+    std::vector<float> field1 = {};
+    std::vector<float> field2 = {};
+    std::vector<float> field3 = {};
+    std::vector<float> field4 = {};
+    std::vector<float> field5 = {};
+    std::vector<float> field6 = {};
+    std::vector<float> field7 = {};
+};
+
+YAML_FIELDS(BenchComponent, field0, field1, field2, field3, field4, field5, field6, field7)
+
+struct BenchOptions
+{
+    std::size_t scenes = 3;
+    std::size_t entities = 1000;
+    std::size_t components = 3;
+    std::size_t fan_out = 3;
+    std::size_t depth = 1;
+    std::size_t lookups = 100000;
+    std::string filename = "bench_scene.yaml";
+    std::string output = {};
+};
+
+struct Timer
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    double seconds() const
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+};
+
+static std::size_t get_peak_rss()
+{
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    #if defined(__APPLE__)
+    return static_cast<std::size_t>(usage.ru_maxrss);
+    #else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+    #endif
+#else
+    return 0;
+#endif
+}
+
+static void generate_fields(
+    std::FILE* file, std::size_t fan_out, std::size_t depth, std::size_t indent
+)
+{
+    std::string padding = std::string(indent, ' ');
+    for (std::size_t i = 0; i < fan_out; i++)
+    {
+        std::fprintf(file, "%sfield%zu:", padding.c_str(), i);
+        if (depth <= 1)
+        {
+            std::vector<float> value = {1.5f, 2.5f, float(i)};
+            std::string str = yaml::Convert<std::vector<float>>().value_to_str(value);
+            std::fprintf(file, " %s\n", str.c_str());
+        }
+        else
+        {
+            std::fputc('\n', file);
+            generate_fields(file, fan_out, depth - 1, indent + 2);
+        }
+    }
+}
+
+/**
+ * @brief Same shape as construct_yaml_example() in main.cpp, scaled up by the options. Written
+ * straight into the file rather than built as a tree first, so the file can be larger than memory
+ * and peak memory only counts the tree parsed from it
+ */
+static bool generate_scene(const BenchOptions& options)
+{
+    std::FILE* file = std::fopen(options.filename.c_str(), "w");
+    if (file == nullptr)
+        return false;
+
+    std::vector<std::string> scene_names = {};
+    for (std::size_t i = 0; i < options.scenes; i++)
+        scene_names.push_back("Scene" + std::to_string(i));
+    std::string names = yaml::Convert<std::vector<std::string>>().value_to_str(scene_names);
+    std::fprintf(file, "SceneNames: %s\n", names.c_str());
+
+    for (const std::string& name : scene_names)
+    {
+        std::fprintf(file, "%s:\n", name.c_str());
+        for (std::size_t i = 0; i < options.entities; i++)
+        {
+            std::fprintf(file, "  Entity%zu:\n", i);
+            for (std::size_t j = 0; j < options.components; j++)
+            {
+                std::fprintf(file, "    Component%zu:\n", j);
+                generate_fields(file, options.fan_out, options.depth, 6);
+            }
+        }
+    }
+
+    return std::fclose(file) == 0;
+}
+
+static std::string get_leaf_path(const BenchOptions& options, std::size_t seed)
+{
+    std::string path = "Scene" + std::to_string(seed % options.scenes);
+    path += "/Entity" + std::to_string(seed * 7919 % options.entities);
+    path += "/Component" + std::to_string(seed * 104729 % options.components);
+    for (std::size_t i = 0; i < options.depth; i++)
+        path += "/field" + std::to_string((seed >> i) % options.fan_out);
+    return path;
+}
+
+static const yaml::Node& find_path(const yaml::Node& root, const std::string& path)
+{
+    const yaml::Node* node = &root;
+    for (std::size_t begin = 0; begin < path.size();)
+    {
+        std::size_t end = std::min(path.find('/', begin), path.size());
+        node = &node->get_child(path.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return *node;
+}
+
+static double measure_shared_reads(
+    const yaml::Node& root, const BenchOptions& options, std::size_t thread_count
+)
+{
+    yaml::SharedDocument document = yaml::SharedDocument(root);
+    std::atomic<bool> stop = false;
+    std::atomic<std::size_t> reads = 0;
+
+    std::vector<std::thread> threads = {};
+    for (std::size_t i = 0; i < thread_count; i++)
+    {
+        threads.emplace_back(
+            [&, i]()
+            {
+                std::string path = get_leaf_path(options, i);
+                std::size_t count = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    yaml::SharedDocument::Snapshot snapshot = document.read();
+                    count += find_path(*snapshot, path).get_value().size() > 0;
+                }
+                reads += count;
+            }
+        );
+    }
+
+    Timer timer = {};
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    stop = true;
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return reads / timer.seconds();
+}
+
+/**
+ * @brief Loads the same component over and over, straight into the struct through YAML_FIELDS or
+ * by opening a tree and converting each field with as<_T>
+ */
+static double measure_component_loads(const std::string& filename, std::size_t count, bool fields)
+{
+    BenchComponent component = {};
+    std::size_t loaded = 0;
+
+    Timer timer = {};
+    for (std::size_t i = 0; i < count; i++)
+    {
+        if (fields)
+            loaded += yaml::load(filename, component);
+        else
+        {
+            yaml::Node node = yaml::open(filename);
+            component.field0 = node["field0"].as<std::vector<float>>();
+            component.field1 = node["field1"].as<std::vector<float>>();
+            component.field2 = node["field2"].as<std::vector<float>>();
+            component.field3 = node["field3"].as<std::vector<float>>();
+            component.field4 = node["field4"].as<std::vector<float>>();
+            component.field5 = node["field5"].as<std::vector<float>>();
+            component.field6 = node["field6"].as<std::vector<float>>();
+            component.field7 = node["field7"].as<std::vector<float>>();
+            loaded += node.get_children().size() == 8;
+        }
+    }
+    double seconds = timer.seconds();
+
+    if (loaded != count || component.field7.size() != 3)
+        std::cerr << "failed to load " << filename << "\n";
+    return count / seconds;
+}
+
+/**
+ * @brief Finds each field name of the component, in the YAML_FIELDS key table or among the
+ * children of its tree with get_child()
+ */
+static double measure_field_lookups(const yaml::Node& node, std::size_t count, bool fields)
+{
+    static constexpr const auto& keys = yaml::Fields<BenchComponent>::keys;
+    std::size_t found = 0;
+
+    Timer timer = {};
+    for (std::size_t i = 0; i < count; i++)
+    {
+        std::string_view name = keys.keys[i % keys.keys.size()];
+        if (fields)
+            found += keys.find(name) < keys.keys.size();
+        else
+            found += node.get_child(std::string(name)).get_value().size() > 0;
+    }
+    double seconds = timer.seconds();
+
+    if (found != count)
+        std::cerr << "failed to find the component fields\n";
+    return count / seconds;
+}
+
+static bool parse_args(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << arg << "\n";
+            return false;
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--scenes")
+            options.scenes = std::stoull(value);
+        else if (arg == "--entities")
+            options.entities = std::stoull(value);
+        else if (arg == "--components")
+            options.components = std::stoull(value);
+        else if (arg == "--fan-out")
+            options.fan_out = std::stoull(value);
+        else if (arg == "--depth")
+            options.depth = std::stoull(value);
+        else if (arg == "--lookups")
+            options.lookups = std::stoull(value);
+        else if (arg == "--file")
+            options.filename = value;
+        else if (arg == "--output")
+            options.output = value;
+        else
+        {
+            std::cerr << "unknown argument " << arg << "\n";
+            return false;
+        }
+    }
+
+    if (options.scenes == 0 || options.entities == 0 || options.components == 0 ||
+        options.fan_out == 0 || options.depth == 0)
+    {
+        std::cerr << "scenes, entities, components, fan-out and depth must be at least 1\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options = {};
+    if (!parse_args(argc, argv, options))
+    {
+        std::cerr << "usage: yaml_bench [--scenes N] [--entities N] [--components N] "
+                     "[--fan-out N] [--depth N] [--lookups N] [--file path] [--output path]\n";
+        return 1;
+    }
+
+    if (!generate_scene(options))
+    {
+        std::cerr << "failed to write " << options.filename << "\n";
+        return 1;
+    }
+    double megabytes = std::filesystem::file_size(options.filename) / (1024.0 * 1024.0);
+
+    std::size_t allocations = s_allocations;
+    Timer parse_timer = {};
+    yaml::Node root_node = yaml::open(options.filename);
+    double parse_seconds = parse_timer.seconds();
+    std::size_t parse_allocations = s_allocations - allocations;
+
+    // NOTE: the parsed tree is written back over the generated file
+    allocations = s_allocations;
+    Timer emit_timer = {};
+    if (!yaml::write(root_node, options.filename))
+    {
+        std::cerr << "failed to write " << options.filename << "\n";
+        return 1;
+    }
+    double emit_seconds = emit_timer.seconds();
+    std::size_t emit_allocations = s_allocations - allocations;
+    double emit_megabytes = std::filesystem::file_size(options.filename) / (1024.0 * 1024.0);
+
+    std::vector<std::string> paths = {};
+    for (std::size_t i = 0; i < 1024; i++)
+        paths.push_back(get_leaf_path(options, i));
+
+    std::size_t found = 0;
+    Timer lookup_timer = {};
+    for (std::size_t i = 0; i < options.lookups; i++)
+        found += find_path(root_node, paths[i % paths.size()]).get_value().size() > 0;
+    double lookup_seconds = lookup_timer.seconds();
+    std::size_t lookups = options.lookups * (3 + options.depth);
+
+    std::vector<const yaml::Node*> leaves = {};
+    for (const std::string& path : paths)
+        leaves.push_back(&find_path(root_node, path));
+
+    float sum = 0;
+    Timer convert_timer = {};
+    for (std::size_t i = 0; i < options.lookups; i++)
+        sum += leaves[i % leaves.size()]->as<std::vector<float>>()[0];
+    double convert_seconds = convert_timer.seconds();
+
+    std::string component_filename = options.filename + ".component";
+    std::vector<float> value = {1.5f, 2.5f, 3.5f};
+    BenchComponent component = {value, value, value, value, value, value, value, value};
+    yaml::save(component, component_filename);
+
+    std::size_t loads = std::max<std::size_t>(options.lookups / 10, 1);
+    double tree_loads = measure_component_loads(component_filename, loads, false);
+    double fields_loads = measure_component_loads(component_filename, loads, true);
+
+    yaml::Node component_node = yaml::open(component_filename);
+    double tree_lookups = measure_field_lookups(component_node, options.lookups, false);
+    double fields_lookups = measure_field_lookups(component_node, options.lookups, true);
+    std::filesystem::remove(component_filename);
+
+    std::string json = "{\n";
+    json += "  \"scenes\": " + std::to_string(options.scenes) + ",\n";
+    json += "  \"entities\": " + std::to_string(options.entities) + ",\n";
+    json += "  \"components\": " + std::to_string(options.components) + ",\n";
+    json += "  \"fan_out\": " + std::to_string(options.fan_out) + ",\n";
+    json += "  \"depth\": " + std::to_string(options.depth) + ",\n";
+    json += "  \"file_megabytes\": " + std::to_string(megabytes) + ",\n";
+    json += "  \"emit_megabytes_per_second\": " + std::to_string(emit_megabytes / emit_seconds);
+    json += ",\n";
+    json += "  \"emit_allocations\": " + std::to_string(emit_allocations) + ",\n";
+    json += "  \"parse_megabytes_per_second\": " + std::to_string(megabytes / parse_seconds);
+    json += ",\n";
+    json += "  \"parse_allocations\": " + std::to_string(parse_allocations) + ",\n";
+    json += "  \"get_child_per_second\": " + std::to_string(lookups / lookup_seconds) + ",\n";
+    json += "  \"as_per_second\": " + std::to_string(options.lookups / convert_seconds) + ",\n";
+    json += "  \"tree_loads_per_second\": " + std::to_string(tree_loads) + ",\n";
+    json += "  \"fields_loads_per_second\": " + std::to_string(fields_loads) + ",\n";
+    json += "  \"tree_field_lookups_per_second\": " + std::to_string(tree_lookups) + ",\n";
+    json += "  \"fields_field_lookups_per_second\": " + std::to_string(fields_lookups) + ",\n";
+
+    json += "  \"shared_reads_per_second\": {";
+    std::size_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    for (std::size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        json += threads > 1 ? ", " : "";
+        json += "\"" + std::to_string(threads) + "\": ";
+        json += std::to_string(measure_shared_reads(root_node, options, threads));
+    }
+    json += "},\n";
+
+    json += "  \"peak_rss_bytes\": " + std::to_string(get_peak_rss()) + "\n";
+    json += "}\n";
+
+    // NOTE: keeps the loops above from being optimized away
+    if (found + static_cast<std::size_t>(sum) == 0)
+        std::cerr << "no leaves found\n";
+
+    if (options.output.empty())
+        std::cout << json;
+    else
+    {
+        std::FILE* file = std::fopen(options.output.c_str(), "w");
+        if (file == nullptr)
+        {
+            std::cerr << "failed to write " << options.output << "\n";
+            return 1;
+        }
+        std::fputs(json.c_str(), file);
+        std::fclose(file);
+    }
+
+    std::filesystem::remove(options.filename);
+    return 0;
+}
@@ -22,7 +22,10 @@
  */
 
 #include "../yaml.hpp"
+#include <atomic>
 #include <iostream>
+#include <thread>
+#include <utility>
 
 struct Vector3
 {
@@ -88,10 +91,33 @@ struct yaml::Convert<Vector3>
             }
         }
 
+        if (j > 0)
+        {
+            number[j] = '\0';
+            vec[index] = std::stof(number);
+        }
+
         return vec;
     }
 };
 
+struct TransformComponent
+{
+    Vector3 translation = {};
+    Vector3 rotation = {};
+    Vector3 scale = {1, 1, 1};
+};
+
+YAML_FIELDS(TransformComponent, translation, rotation, scale)
+
+struct Entity
+{
+    std::string name = {};
+    TransformComponent transform = {};
+};
+
+YAML_FIELDS(Entity, name, transform)
+
 yaml::Node construct_yaml_example()
 {
     std::cout << "Construct yaml file example:\n\n";
@@ -134,6 +160,14 @@ void write_to_file_example(const yaml::Node& node, const std::string& filename)
         std::cout << "Write to file example:\n\n";
         std::cout << "failed to write to file\n";
     }
+
+    // nothing has changed since the last write, so this leaves the file alone
+    yaml::WriteOptions options = {.skip_unchanged = true, .atomic = true};
+    if (!yaml::write(node, filename, options))
+    {
+        std::cout << "Write to file example:\n\n";
+        std::cout << "failed to write to file atomically\n";
+    }
 }
 
 void read_file_example(const std::string& filename)
@@ -143,10 +177,369 @@ void read_file_example(const std::string& filename)
     std::cout << root_node.get_as_string() << "\n";
 }
 
+void struct_fields_example(const std::string& filename)
+{
+    std::cout << "Struct fields example:\n\n";
+
+    Entity entity = {};
+    entity.name = "Player";
+    entity.transform.translation = Vector3{4, 5, 6};
+    entity.transform.rotation = Vector3{0, 90, 0};
+
+    if (!yaml::save(entity, filename))
+    {
+        std::cout << "failed to write to file\n";
+        return;
+    }
+
+    Entity loaded = {};
+    yaml::load(filename, loaded);
+    std::cout << yaml::get_fields_as_string(loaded) << "\n";
+}
+
+void open_many_example(const std::vector<std::string>& filenames)
+{
+    std::cout << "Open many example:\n\n";
+
+    std::vector<yaml::OpenResult> results = yaml::open_many(filenames);
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        std::cout << filenames[i] << ": ";
+        if (results[i].success)
+            std::cout << results[i].node.get_children().size() << " top level nodes\n";
+        else if (results[i].parse.status == yaml::ParseStatus::FileNotFound)
+            std::cout << "failed to open (errno " << results[i].error << ")\n";
+        else
+            std::cout << "failed to parse at line " << results[i].parse.line << "\n";
+    }
+    std::cout << "\n";
+}
+
+void diff_example(const std::string& filename)
+{
+    std::cout << "Diff example:\n\n";
+
+    yaml::Node before = yaml::open(filename);
+    yaml::Node after = yaml::open(filename);
+    std::cout << "loaded twice, compare: " << (before == after ? "equal" : "different") << "\n";
+
+    // moving nodes around clears the cached hashes above them
+    std::swap(after.get_child(0), after.get_child(1));
+    bool same_hash = before.get_hash() == after.get_hash();
+    std::cout << "swapped, hash " << (same_hash ? "same" : "changed") << ", compare: "
+              << (before == after ? "equal" : "different") << "\n";
+
+    std::swap(after.get_child(0), after.get_child(1));
+    same_hash = before.get_hash() == after.get_hash();
+    std::cout << "swapped back, hash " << (same_hash ? "same" : "changed") << ", compare: "
+              << (before == after ? "equal" : "different") << "\n";
+
+    after["TestScene"]["Entity1"]["TransformComponent"]["scale"] = Vector3{2, 2, 2};
+    after["MenuScene"] << yaml::node("Entity3");
+    after.get_child("LastScene").pop_back();
+    std::cout << "after edits, compare: " << (before == after ? "equal" : "different") << "\n";
+
+    for (const yaml::Change& change : yaml::diff(before, after))
+    {
+        const char* type = change.type == yaml::ChangeType::Added     ? "added"
+                           : change.type == yaml::ChangeType::Removed ? "removed"
+                                                                      : "modified";
+        std::cout << type << ": " << change.path << "\n";
+    }
+    std::cout << "\n";
+}
+
+void journal_example(const yaml::Node& node, const std::string& filename)
+{
+    std::cout << "Journal example:\n\n";
+    yaml::write(node, filename);
+
+    {
+        yaml::Node root_node = {};
+        yaml::Journal journal = yaml::Journal(root_node, filename);
+        root_node["MenuScene"]["Entity0"]["TransformComponent"]["scale"] = Vector3{3, 3, 3};
+        root_node["LastScene"].pop_back(2);
+        journal.save();
+        std::cout << "journal log size: " << journal.get_log_size() << " bytes\n";
+    }
+
+    // the base file hasn't been rewritten, the log is replayed on top of it
+    yaml::Node root_node = {};
+    yaml::Journal::open(root_node, filename);
+    std::cout << yaml::get_root_as_string(root_node["LastScene"]) << "\n";
+
+    // a multi-line value can't be written into the base file, so it is kept in the log
+    {
+        yaml::Node journaled = {};
+        yaml::Journal journal = yaml::Journal(journaled, filename);
+        journaled << yaml::node("Notes", std::string("line1\nline2"));
+        bool compacted = journal.compact();
+        journal.save();
+        std::cout << "compacted multi-line value: " << (compacted ? "yes" : "no") << "\n";
+    }
+
+    yaml::Journal::open(root_node, filename);
+    bool kept = root_node["Notes"].as<std::string>() == "line1\nline2";
+    std::cout << "multi-line value after reopening: " << (kept ? "kept" : "lost") << "\n\n";
+}
+
+void watched_document_example(const yaml::Node& node, const std::string& filename)
+{
+    std::cout << "Watched document example:\n\n";
+    yaml::write(node, filename);
+
+    yaml::WatchedDocument document = yaml::WatchedDocument(filename);
+    document.subscribe([](const yaml::Change& change) { std::cout << change.path << " changed\n"; });
+
+    // edit the file behind the documents back, then pick up the change
+    yaml::Node edited = yaml::open(filename);
+    edited["TestScene"]["Entity2"]["TransformComponent"]["rotation"] = Vector3{0, 0, 0};
+    yaml::write(edited, filename);
+
+    document.poll();
+    std::cout << "\n";
+}
+
+void shared_document_example(const yaml::Node& node)
+{
+    std::cout << "Shared document example:\n\n";
+
+    yaml::SharedDocument document = yaml::SharedDocument(node);
+    std::thread writer = std::thread(
+        [&]()
+        {
+            for (std::size_t i = 0; i < 100; i++)
+            {
+                document.update([&](yaml::Node& root)
+                                { root["MenuScene"]["Entity0"] << yaml::node("Frame", i); });
+            }
+        }
+    );
+
+    std::size_t largest = 0;
+    while (largest < 100)
+    {
+        // each snapshot is a consistent version of the tree, even while the writer publishes
+        yaml::SharedDocument::Snapshot snapshot = document.read();
+        const yaml::Node& entity = snapshot->get_child("MenuScene").get_child(0);
+        largest = std::max(largest, entity.get_children().size() - 1);
+    }
+
+    writer.join();
+    std::cout << "read all " << largest << " published versions\n\n";
+}
+
+void write_async_example(const yaml::Node& node, const std::string& filename)
+{
+    std::cout << "Write async example:\n\n";
+
+    // the second write replaces the first if it hasn't started yet, both complete either way
+    std::future<bool> first = yaml::write_async(node, filename);
+    std::future<bool> second = yaml::write_async(node, filename, {.atomic = true});
+
+    // a tree that is already shared is handed to the writer without being copied
+    std::shared_ptr<const yaml::Node> shared = std::make_shared<const yaml::Node>(node);
+    std::future<bool> third = yaml::write_async(shared, filename, {.atomic = true});
+
+    bool result = first.get() && second.get() && third.get();
+    std::cout << (result ? "written in the background" : "failed to write to file") << "\n\n";
+}
+
+void anchors_example(const yaml::Node& node, const std::string& filename)
+{
+    std::cout << "Anchors example:\n\n";
+
+    // every entity's transform is the same, so they are written once and aliased after that
+    yaml::write(node, filename, {.deduplicate = true});
+
+    yaml::Node root_node = yaml::open(filename);
+    const yaml::Node& first = root_node.get_child("MenuScene").get_child("Entity0");
+    const yaml::Node& second = root_node.get_child("TestScene").get_child("Entity1");
+    std::cout << "entities share memory: " << (first.get_shared() == second.get_shared()) << "\n";
+
+    // modifying a shared node gives it its own copy, the others are left as they were
+    root_node["TestScene"]["Entity1"]["TransformComponent"]["scale"] = Vector3{2, 2, 2};
+    std::cout << "after modifying one: " << (first.get_shared() == second.get_shared()) << "\n\n";
+}
+
+void stats_example(const std::string& filename)
+{
+    std::cout << "Stats example:\n\n";
+    if constexpr (!yaml::stats_enabled())
+    {
+        std::cout << "built without YAML_STATS\n\n";
+        return;
+    }
+
+    yaml::Stats stats = {};
+    yaml::set_stats_sink(
+        &stats,
+        [](yaml::StatsPhase phase, const yaml::Stats& operation)
+        {
+            if (phase == yaml::StatsPhase::Open)
+                std::cout << "opened " << operation.lines << " lines\n";
+        }
+    );
+
+    yaml::Node node = yaml::open(filename);
+    yaml::write(node, filename);
+    yaml::set_stats_sink(nullptr);
+
+    std::cout << "read " << stats.bytes_read << " bytes into " << stats.nodes_created
+              << " nodes, " << stats.max_depth << " deep\n";
+    std::cout << "io " << stats.io_ns << "ns, tokenize " << stats.tokenize_ns << "ns, build "
+              << stats.build_ns << "ns\n";
+    std::cout << "wrote " << stats.bytes_written << " bytes in " << stats.write_file_ns
+              << "ns\n\n";
+}
+
+void compact_example(const yaml::Node& node)
+{
+    std::cout << "Compact example:\n\n";
+
+    yaml::Node copy = node;
+    for (std::size_t i = 0; i < 100; i++)
+        copy["TestScene"] << yaml::node("Temporary" + std::to_string(i), std::string(64, 'x'));
+    copy["TestScene"].pop_back(100);
+
+    yaml::MemoryUsage before = copy.memory_usage();
+    yaml::compact(copy, yaml::CompactOptions{.share_duplicates = true});
+    yaml::MemoryUsage after = copy.memory_usage();
+
+    std::cout << "before " << before.total() << " bytes, " << before.slack << " unused\n";
+    std::cout << "after " << after.total() << " bytes, " << after.slack << " unused\n\n";
+}
+
+// parsed while compiling, nothing is read or allocated at startup
+constexpr auto& default_settings = yaml::static_document<R"(Window:
+  width: 1280
+  height: 720
+  fullscreen: false
+Audio:
+  volume: 0.8
+)">;
+
+static_assert(default_settings["Window"]["width"].get_value() == "1280");
+
+void static_document_example()
+{
+    std::cout << "Static document example:\n\n";
+
+    float volume = default_settings["Audio"]["volume"].as<float>();
+    std::cout << "default volume " << volume << "\n";
+
+    // copy into a regular node when it needs changing
+    yaml::Node settings = default_settings.to_node();
+    settings["Window"]["fullscreen"] = true;
+    std::cout << settings.get_as_string() << "\n";
+}
+
+void layered_config_example()
+{
+    std::cout << "Layered config example:\n\n";
+
+    yaml::Node defaults = default_settings.to_node();
+    yaml::Node overrides = {};
+    overrides << yaml::node("Window");
+    overrides["Window"] << yaml::node("width", 1920);
+    overrides["Window"] << yaml::node("vsync", true);
+
+    // looked up through both layers without building the merged tree
+    yaml::LayeredView view = yaml::LayeredView({&defaults, &overrides});
+    std::cout << "width " << view["Window"]["width"].as<std::int32_t>() << ", height "
+              << view["Window"]["height"].as<std::int32_t>() << "\n";
+
+    yaml::merge(defaults, overrides);
+    std::cout << defaults.get_as_string() << "\n";
+}
+
+void parse_limits_example(const std::string& filename)
+{
+    std::cout << "Parse limits example:\n\n";
+
+    yaml::ParseOptions options = {};
+    options.max_depth = 3;
+    options.max_nodes = 1000;
+    options.max_bytes = 1024 * 1024;
+    options.max_scalar_size = 256;
+
+    yaml::Node node = {};
+    yaml::ParseResult result = node.open(filename, options);
+    if (!result)
+        std::cout << "rejected at line " << result.line << "\n\n";
+    else
+        std::cout << "parsed " << node.get_children().size() << " fields\n\n";
+}
+
+void traversal_example(yaml::Node node)
+{
+    std::cout << "Traversal example:\n\n";
+
+    std::size_t count = 0;
+    for (const yaml::Node& child : std::as_const(node).depth_first())
+        count += child.get_children().empty();
+    std::cout << count << " leaf nodes\n";
+
+    // a callback taking a const node goes through the const overload, leaving shared nodes shared
+    node << yaml::alias("MenuCopy", node["MenuScene"].share("Menu"));
+    std::atomic<std::size_t> visited = 0;
+    yaml::parallel_for_each(node, 2, [&](const yaml::Node&) { visited++; });
+    bool shared = std::as_const(node).back().get_shared() != nullptr;
+    std::cout << visited << " nodes visited, alias " << (shared ? "still shared" : "copied")
+              << "\n";
+
+    // each entity is visited on its own worker thread
+    yaml::parallel_for_each(
+        node, 2,
+        [](yaml::Node& child)
+        {
+            if (child.get_name() == "scale")
+                child = Vector3{2, 2, 2};
+        }
+    );
+    std::cout << node["TestScene"]["Entity0"]["TransformComponent"]["scale"].get_value()
+              << "\n\n";
+}
+
+void schema_example(yaml::Node node, const std::string& filename)
+{
+    std::cout << "Schema example:\n\n";
+
+    yaml::Schema schema = yaml::Schema();
+    schema.required<std::vector<std::string>>("SceneNames");
+    schema.required("*/*/TransformComponent");
+    schema.sequence<float>("*/*/TransformComponent/translation", 3, 3);
+    schema.required<Vector3>("*/*/TransformComponent/scale");
+
+    std::vector<yaml::Violation> violations = {};
+    schema.validate_file(filename, violations);
+    std::cout << violations.size() << " violations in " << filename << "\n";
+
+    node["TestScene"]["Entity0"]["TransformComponent"]["translation"] = std::vector<float>{1, 2};
+    for (const yaml::Violation& violation : schema.validate(node))
+        std::cout << "invalid: " << violation.path << "\n";
+    std::cout << "\n";
+}
+
 int main(int argc, char** argv)
 {
     yaml::Node node = construct_yaml_example();
     write_to_file_example(node, "scene_save.yaml");
     read_file_example("scene_save.yaml");
+    diff_example("scene_save.yaml");
+    journal_example(node, "journal_save.yaml");
+    watched_document_example(node, "watched_save.yaml");
+    shared_document_example(node);
+    write_async_example(node, "async_save.yaml");
+    anchors_example(node, "anchors_save.yaml");
+    struct_fields_example("entity_save.yaml");
+    open_many_example({"scene_save.yaml", "entity_save.yaml", "missing.yaml"});
+    stats_example("scene_save.yaml");
+    compact_example(node);
+    static_document_example();
+    layered_config_example();
+    parse_limits_example("scene_save.yaml");
+    traversal_example(node);
+    schema_example(node, "scene_save.yaml");
     return 0;
 }
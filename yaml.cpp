@@ -23,13 +23,151 @@
 
 #include "yaml.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
 #include <cinttypes>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
 #include <iostream>
+#include <mutex>
 #include <string.h>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__linux__)
+    #include <sys/inotify.h>
+#endif
 
 namespace yaml {
 
+Stats& Stats::operator+=(const Stats& other)
+{
+    bytes_read += other.bytes_read;
+    bytes_written += other.bytes_written;
+    lines += other.lines;
+    nodes_created += other.nodes_created;
+    max_depth = std::max(max_depth, other.max_depth);
+    estimated_allocations += other.estimated_allocations;
+    open_ns += other.open_ns;
+    io_ns += other.io_ns;
+    tokenize_ns += other.tokenize_ns;
+    build_ns += other.build_ns;
+    write_file_ns += other.write_file_ns;
+    get_as_string_ns += other.get_as_string_ns;
+    conversions += other.conversions;
+    convert_ns += other.convert_ns;
+    return *this;
+}
+
+#if defined(YAML_STATS)
+
+static std::mutex s_stats_mutex = {};
+static Stats* s_stats_sink = nullptr;
+static StatsCallback s_stats_callback = nullptr;
+
+// NOTE: checked before taking the lock, so nothing is collected while there is nowhere to send it
+static std::atomic<bool> s_stats_active = false;
+
+thread_local Stats* detail::current_stats = nullptr;
+
+void set_stats_sink(Stats* sink, StatsCallback callback)
+{
+    std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(s_stats_mutex);
+    s_stats_sink = sink;
+    s_stats_callback = std::move(callback);
+    s_stats_active = sink != nullptr || s_stats_callback != nullptr;
+}
+
+std::uint64_t detail::now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()
+    )
+        .count();
+}
+
+void detail::record_conversion(std::uint64_t start_ns)
+{
+    std::uint64_t elapsed = now_ns() - start_ns;
+    if (current_stats != nullptr)
+    {
+        current_stats->conversions++;
+        current_stats->convert_ns += elapsed;
+    }
+    else if (s_stats_active.load(std::memory_order_relaxed))
+    {
+        // NOTE: conversions outside of an operation go straight to the sink without a callback,
+        // otherwise it would be called for every single value
+        std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(s_stats_mutex);
+        if (s_stats_sink != nullptr)
+        {
+            s_stats_sink->conversions++;
+            s_stats_sink->convert_ns += elapsed;
+        }
+    }
+}
+
+detail::StatsScope::StatsScope(StatsPhase phase) : m_phase(phase), m_previous(current_stats)
+{
+    if (m_previous == nullptr && s_stats_active.load(std::memory_order_relaxed))
+    {
+        m_start = now_ns();
+        current_stats = &m_stats;
+    }
+}
+
+detail::StatsScope::~StatsScope()
+{
+    if (current_stats != &m_stats)
+        return;
+    current_stats = nullptr;
+
+    std::uint64_t elapsed = now_ns() - m_start;
+    switch (m_phase)
+    {
+    case StatsPhase::Open:
+        m_stats.open_ns += elapsed;
+        break;
+    case StatsPhase::WriteFile:
+        m_stats.write_file_ns += elapsed;
+        break;
+    case StatsPhase::GetAsString:
+        m_stats.get_as_string_ns += elapsed;
+        break;
+    }
+
+    StatsCallback callback = nullptr;
+    {
+        std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(s_stats_mutex);
+        if (s_stats_sink != nullptr)
+            *s_stats_sink += m_stats;
+        callback = s_stats_callback;
+    }
+
+    // NOTE: called without the lock held, so the callback can use the library itself
+    if (callback != nullptr)
+        callback(m_phase, m_stats);
+}
+
+#else
+
+void set_stats_sink(Stats*, StatsCallback) {}
+
+#endif
+
 const std::size_t Node::null_index = std::string::npos;
 
 Node::Node(const std::string& field_name) : m_name(field_name) {}
@@ -38,47 +176,75 @@ Node::Node(const std::string& field_name, const std::string& value)
 {
 }
 
+Node::Node(const std::string& field_name, std::shared_ptr<const Node> shared)
+    : m_name(field_name), m_shared(std::move(shared))
+{
+}
+
+// NOTE: a copy or a node moved out of a tree isn't part of that tree, so both start without a
+// parent. The parent of a node added to another is set when it is added
 Node::Node(const Node& other)
     : m_name(other.m_name),
       m_value(other.m_value),
       m_children(other.m_children),
-      m_parent(other.m_parent)
+      m_shared(other.m_shared)
 {
+    _relink_children();
+    _copy_hash(other);
 }
 
-Node::Node(Node&& other)
+Node::Node(Node&& other) noexcept
     : m_name(std::move(other.m_name)),
       m_value(std::move(other.m_value)),
       m_children(std::move(other.m_children)),
-      m_parent(other.m_parent)
+      m_shared(std::move(other.m_shared))
 {
-    other.m_parent = nullptr;
+    _relink_children();
+    _copy_hash(other);
+
+    // NOTE: through invalidate_hash() so the moved-from node's parents don't keep its old hash
+    other.invalidate_hash();
 }
 
+// NOTE: assigning replaces the contents of the node but keeps its place within its tree
 Node& Node::operator=(const Node& other)
 {
     m_name = other.m_name;
     m_value = other.m_value;
     m_children = other.m_children;
-    m_parent = other.m_parent;
+    m_shared = other.m_shared;
+    _relink_children();
+
+    invalidate_hash();
+    _copy_hash(other);
+
+    if (detail::journal_count.load(std::memory_order_relaxed) > 0)
+        _record('s');
 
     return *this;
 }
 
-Node& Node::operator=(Node&& other)
+Node& Node::operator=(Node&& other) noexcept
 {
     m_name = std::move(other.m_name);
     m_value = std::move(other.m_value);
     m_children = std::move(other.m_children);
-    m_parent = other.m_parent;
+    m_shared = std::move(other.m_shared);
+    _relink_children();
+
+    invalidate_hash();
+    _copy_hash(other);
+    other.invalidate_hash();
 
-    other.m_parent = nullptr;
+    if (detail::journal_count.load(std::memory_order_relaxed) > 0)
+        _record('s');
 
     return *this;
 }
 
 Node& Node::get_child(const std::string& field_name)
 {
+    _unshare();
     for (std::size_t i = 0; i < m_children.size(); i++)
     {
         if (m_children[i].get_name() == field_name)
@@ -89,10 +255,14 @@ Node& Node::get_child(const std::string& field_name)
         false && "YAML ASSERT: failed to find child with given field_name as it doesn't exist in "
                  "children vector"
     );
+
+    // NOTE: asserts are compiled out in release builds, where there is no node to return
+    std::abort();
 }
 
 Node& Node::get_child(std::size_t index)
 {
+    _unshare();
     if (index < m_children.size())
         return m_children[index];
 
@@ -100,77 +270,463 @@ Node& Node::get_child(std::size_t index)
         false &&
         "YAML ASSERT: failed to find child with given index as it is greater than children vector"
     );
+
+    std::abort();
+}
+
+const Node& Node::get_child(const std::string& field_name) const
+{
+    const std::vector<Node>& children = _content().m_children;
+    for (std::size_t i = 0; i < children.size(); i++)
+    {
+        if (children[i].get_name() == field_name)
+            return children[i];
+    }
+
+    assert(
+        false && "YAML ASSERT: failed to find child with given field_name as it doesn't exist in "
+                 "children vector"
+    );
+
+    std::abort();
+}
+
+const Node& Node::get_child(std::size_t index) const
+{
+    const std::vector<Node>& children = _content().m_children;
+    if (index < children.size())
+        return children[index];
+
+    assert(
+        false &&
+        "YAML ASSERT: failed to find child with given index as it is greater than children vector"
+    );
+
+    std::abort();
 }
 
 Node& Node::operator<<(const Node& other)
 {
     push_back(other);
-    m_children.back().m_parent = m_parent;
     return *this;
 }
 
+void Node::push_back(const Node& node)
+{
+    _unshare();
+    _add_child(Node(node));
+    if (detail::journal_count.load(std::memory_order_relaxed) > 0)
+        _record('a');
+}
+
+void Node::push_back(Node&& node)
+{
+    _unshare();
+    _add_child(std::move(node));
+    if (detail::journal_count.load(std::memory_order_relaxed) > 0)
+        _record('a');
+}
+
+void Node::pop_back(std::size_t count)
+{
+    _unshare();
+    m_children.resize(m_children.size() - count);
+    invalidate_hash();
+    if (detail::journal_count.load(std::memory_order_relaxed) > 0)
+        _record('p', count);
+}
+
 std::string Node::get_as_string() const
 {
+    _YAML_STATS(detail::StatsScope scope = detail::StatsScope(StatsPhase::GetAsString));
     std::string str = {};
     _construct_string(str, *this, 0);
     return str;
 }
 
 bool Node::open(const std::string& filename)
+{
+    return static_cast<bool>(open(filename, ParseOptions()));
+}
+
+ParseResult Node::open(const std::string& filename, const ParseOptions& options)
+{
+    _YAML_STATS(detail::StatsScope scope = detail::StatsScope(StatsPhase::Open));
+    return _open_file(filename, options);
+}
+
+struct ExpandedSize
+{
+    std::size_t nodes = 0;
+    std::size_t depth = 0;
+};
+
+static std::size_t _saturating_add(std::size_t a, std::size_t b)
+{
+    constexpr std::size_t max = std::numeric_limits<std::size_t>::max();
+    return a > max - b ? max : a + b;
+}
+
+// Nodes and levels below node once every alias is expanded. Each shared node is only measured
+// once, so a file made of aliases of aliases makes the result large rather than this slow
+static ExpandedSize _get_expanded_size(
+    const Node& node, std::unordered_map<const Node*, ExpandedSize>& measured
+)
+{
+    const Node* shared = node.get_shared().get();
+    if (shared != nullptr)
+    {
+        auto found = measured.find(shared);
+        if (found != measured.end())
+            return found->second;
+    }
+
+    ExpandedSize size = {};
+    for (const Node& child : node.get_children())
+    {
+        ExpandedSize child_size = _get_expanded_size(child, measured);
+        size.nodes = _saturating_add(size.nodes, _saturating_add(child_size.nodes, 1));
+        size.depth = std::max(size.depth, child_size.depth + 1);
+    }
+
+    if (shared != nullptr)
+        measured.emplace(shared, size);
+    return size;
+}
+
+ParseResult Node::_open_file(const std::string& filename, const ParseOptions& options)
+{
+    ParseState state = ParseState{nullptr, options};
+    return _open_file(filename, state);
+}
+
+ParseResult Node::_open_file(const std::string& filename, ParseState& state)
 {
     m_children.clear();
+    m_shared = nullptr;
+    invalidate_hash();
 
-    std::FILE* file = std::fopen(filename.c_str(), "r");
-    if (file != nullptr)
+    state.file = std::fopen(filename.c_str(), "r");
+    if (state.file == nullptr)
+        return ParseResult{ParseStatus::FileNotFound};
+
+    _read_node(state, *this);
+    std::fclose(state.file);
+    state.file = nullptr;
+
+    if (state.status == ParseStatus::Success && state.has_references)
     {
-        _read_node(file, this, 0);
-        std::fclose(file);
-        return true;
+        std::unordered_map<std::string, std::shared_ptr<const Node>> anchors = {};
+        _resolve_references(*this, anchors);
+
+        // NOTE: anything walking the tree sees every alias as a full copy, so that is what the
+        // limits are checked against
+        std::unordered_map<const Node*, ExpandedSize> measured = {};
+        ExpandedSize size = _get_expanded_size(*this, measured);
+        if (size.nodes > state.options.max_nodes)
+            state.status = ParseStatus::TooManyNodes;
+        else if (size.depth > state.options.max_depth)
+            state.status = ParseStatus::TooDeep;
     }
-    return false;
+
+    if (state.status != ParseStatus::Success)
+    {
+        m_children = std::vector<Node>();
+        invalidate_hash();
+        return ParseResult{state.status, state.line};
+    }
+    return ParseResult{};
 }
 
 bool Node::compare(const Node& other) const
 {
-    if (m_name != other.m_name || m_value != other.m_value || m_parent != other.m_parent)
+    return this == &other || (m_name == other.m_name && _equal_content(*this, other));
+}
+
+bool Node::_equal_content(const Node& node, const Node& other)
+{
+    if (&node._content() == &other._content())
+        return true;
+
+    // NOTE: different hashes prove the subtrees differ, but equal ones could still be a collision
+    if (node._get_content_hash() != other._get_content_hash())
         return false;
 
-    for (std::size_t i = 0; i < m_children.size(); i++)
+    const std::vector<Node>& children = node.get_children();
+    const std::vector<Node>& other_children = other.get_children();
+    if (node.get_value() != other.get_value() || children.size() != other_children.size())
+        return false;
+
+    for (std::size_t i = 0; i < children.size(); i++)
     {
-        if (!m_children[i].compare(other.m_children[i]))
+        if (!children[i].compare(other_children[i]))
             return false;
     }
-
     return true;
 }
 
+std::uint64_t Node::get_hash() const
+{
+    return detail::hash_str(m_name, _get_content_hash() ^ m_name.size());
+}
+
+std::uint64_t Node::_get_content_hash() const
+{
+    // NOTE: only the value and children are cached, so a shared node's hash is the same no matter
+    // which name it is used under
+    if (m_hash_valid.load(std::memory_order_acquire))
+        return m_hash.load(std::memory_order_relaxed);
+
+    std::uint64_t hash = 0;
+    if (m_shared != nullptr)
+        hash = m_shared->_get_content_hash();
+    else
+    {
+        hash = detail::hash_str(m_value, m_value.size());
+        for (const Node& child : m_children)
+        {
+            hash ^= child.get_hash();
+            hash *= 1099511628211ull;
+        }
+    }
+
+    // NOTE: const readers on other threads can get here at the same time, but they all store the
+    // same hash
+    m_hash.store(hash, std::memory_order_relaxed);
+    m_hash_valid.store(true, std::memory_order_release);
+    return hash;
+}
+
+void Node::_copy_hash(const Node& other)
+{
+    bool valid = other.m_hash_valid.load(std::memory_order_acquire);
+    m_hash.store(other.m_hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_hash_valid.store(valid, std::memory_order_release);
+}
+
+std::shared_ptr<const Node> Node::share(const std::string& anchor)
+{
+    if (m_shared != nullptr)
+        return m_shared;
+
+    std::shared_ptr<Node> shared = std::make_shared<Node>(anchor, std::move(m_value));
+    shared->m_children = std::move(m_children);
+    shared->_relink_children();
+
+    m_value.clear();
+    m_children.clear();
+    m_shared = shared;
+    return m_shared;
+}
+
+void Node::_copy_shared()
+{
+    std::shared_ptr<const Node> shared = std::move(m_shared);
+    m_value = shared->m_value;
+    m_children = shared->m_children;
+    _relink_children();
+}
+
+void Node::invalidate_hash()
+{
+    // a parent's hash can only be valid if all of its children's are, so stop at the first node
+    // that is already invalid
+    for (Node* node = this; node != nullptr && node->m_hash_valid.load(std::memory_order_relaxed);
+         node = node->m_parent)
+    {
+        node->m_hash_valid.store(false, std::memory_order_relaxed);
+    }
+}
+
 std::size_t Node::exists(const std::string& field_name) const
 {
-    for (std::size_t i = 0; i < m_children.size(); i++)
+    const std::vector<Node>& children = get_children();
+    for (std::size_t i = 0; i < children.size(); i++)
     {
-        if (m_children[i].get_name() == field_name)
+        if (children[i].get_name() == field_name)
             return i;
     }
 
     return null_index;
 }
 
+#if defined(YAML_STATS)
+static void _record_write(std::size_t size)
+{
+    if (detail::current_stats != nullptr)
+        detail::current_stats->bytes_written += size;
+}
+#endif
+
 bool Node::write_file(std::FILE* file) const
 {
-    for (std::size_t i = 0; i < m_children.size(); i++)
+    _YAML_STATS(detail::StatsScope scope = detail::StatsScope(StatsPhase::WriteFile));
+    std::string str = {};
+    str.reserve(write_buffer_size());
+
+    WriteContext context = WriteContext{str, file};
+    return _write_children(context);
+}
+
+static bool _file_equals(const std::string& filename, const std::string& contents)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    bool equal = false;
+    struct stat info = {};
+    if (::fstat(fd, &info) == 0 && static_cast<std::size_t>(info.st_size) == contents.size())
     {
-        bool result = _write_node(file, m_children[i], 0);
-        if (!result)
-            return false;
+        if (contents.empty())
+            equal = true;
+        else
+        {
+            void* data = ::mmap(nullptr, contents.size(), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED)
+            {
+                equal = memcmp(data, contents.data(), contents.size()) == 0;
+                ::munmap(data, contents.size());
+            }
+        }
+    }
+
+    ::close(fd);
+    return equal;
+#else
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    char buffer[4096];
+    std::size_t offset = 0;
+    bool equal = true;
+    while (equal)
+    {
+        std::size_t size = std::fread(buffer, 1, sizeof(buffer), file);
+        if (size == 0)
+            break;
+        equal = offset + size <= contents.size() &&
+                memcmp(buffer, contents.data() + offset, size) == 0;
+        offset += size;
+    }
+
+    std::fclose(file);
+    return equal && offset == contents.size();
+#endif
+}
+
+// Creates a file next to filename that no other writer is using, with the same permissions as
+// filename when it exists
+static std::FILE* _open_temp_file(const std::string& filename, std::string& temp_name)
+{
+    static std::atomic<std::uint64_t> s_counter = 0;
+
+#if defined(__unix__) || defined(__APPLE__)
+    std::string unique = std::to_string(::getpid());
+#else
+    std::string unique = std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+
+    for (std::size_t attempt = 0; attempt < 100; attempt++)
+    {
+        temp_name = filename + "." + unique + "." + std::to_string(s_counter++) + ".tmp";
+
+        // NOTE: "x" fails rather than opening a file that already exists
+        std::FILE* file = std::fopen(temp_name.c_str(), "wx");
+        if (file != nullptr)
+        {
+#if defined(__unix__) || defined(__APPLE__)
+            struct stat info = {};
+            if (::stat(filename.c_str(), &info) == 0)
+                ::fchmod(fileno(file), info.st_mode & 07777);
+#endif
+            return file;
+        }
+        if (errno != EEXIST)
+            return nullptr;
     }
+    return nullptr;
+}
+
+static bool _sync_directory(const std::string& filename)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    std::filesystem::path path = std::filesystem::path(filename);
+    std::string directory = path.has_parent_path() ? path.parent_path().string() : ".";
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    bool result = ::fsync(fd) == 0;
+    ::close(fd);
+    return result;
+#else
     return true;
+#endif
 }
 
-bool Node::write_file(const std::string& filename) const
+bool Node::write_file(const std::string& filename, const WriteOptions& options) const
 {
-    std::FILE* file = std::fopen(filename.c_str(), "w");
-    bool result = write_file(file);
-    std::fclose(file);
+    _YAML_STATS(detail::StatsScope scope = detail::StatsScope(StatsPhase::WriteFile));
+    std::string contents = {};
+    if (options.skip_unchanged)
+    {
+        WriteContext context = WriteContext{contents, nullptr, options.deduplicate};
+        _write_children(context);
+
+        if (_file_equals(filename, contents))
+            return true;
+    }
+
+    std::string target = filename;
+    std::FILE* file = nullptr;
+    if (options.atomic)
+        file = _open_temp_file(filename, target);
+    else
+        file = std::fopen(target.c_str(), "w");
+    if (file == nullptr)
+        return false;
+
+    bool result = false;
+    if (options.skip_unchanged)
+    {
+        result = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+        _YAML_STATS(_record_write(contents.size()));
+    }
+    else
+    {
+        contents.reserve(write_buffer_size());
+        WriteContext context = WriteContext{contents, file, options.deduplicate};
+        result = _write_children(context);
+    }
+
+    if (options.atomic)
+    {
+        result = result && std::fflush(file) == 0;
+#if defined(__unix__) || defined(__APPLE__)
+        // make sure the contents are on disk before the rename makes them visible
+        result = result && ::fsync(fileno(file)) == 0;
+#endif
+    }
+    result = std::fclose(file) == 0 && result;
+
+    if (options.atomic)
+    {
+        std::error_code error = {};
+        if (result)
+            std::filesystem::rename(target, filename, error);
+        if (!result || error)
+        {
+            std::remove(target.c_str());
+            return false;
+        }
+
+        // make sure the rename itself survives a crash
+        _sync_directory(filename);
+    }
+
     return result;
 }
 
@@ -185,6 +741,43 @@ bool Node::write_if_file_exists(const std::string& filename) const
     return false;
 }
 
+void Node::_relink_children()
+{
+    for (Node& child : m_children)
+        child.m_parent = this;
+}
+
+#if defined(YAML_STATS)
+static void _record_node(const Node& node, const std::vector<Node>& children)
+{
+    static const std::size_t small_string_size = std::string().capacity();
+
+    Stats* stats = detail::current_stats;
+    if (stats == nullptr)
+        return;
+
+    stats->nodes_created++;
+    stats->estimated_allocations += children.size() == children.capacity();
+    stats->estimated_allocations += node.get_name().size() > small_string_size;
+    stats->estimated_allocations += node.get_value().size() > small_string_size;
+}
+#endif
+
+Node& Node::_add_child(Node&& node)
+{
+    _YAML_STATS(_record_node(node, m_children));
+    const Node* data = m_children.data();
+    m_children.push_back(std::move(node));
+
+    // NOTE: moving the children into a larger array leaves them without a parent
+    if (m_children.data() != data)
+        _relink_children();
+    else
+        m_children.back().m_parent = this;
+    invalidate_hash();
+    return m_children.back();
+}
+
 void Node::_construct_string(std::string& str, const Node& node, std::size_t indent)
 {
     char str_indent[1024];
@@ -192,185 +785,2025 @@ void Node::_construct_string(std::string& str, const Node& node, std::size_t ind
         str_indent[i] = ' ';
     str_indent[indent] = '\0';
 
+    const std::vector<Node>& children = node.get_children();
     if (node.get_name().size() > 0)
     {
         str += str_indent + node.get_name() + ": ";
-        if (node.m_value.size() > 0)
+        if (node.get_value().size() > 0)
             str += node.get_value() + "\n";
         else
         {
             str += "\n";
-            for (std::size_t i = 0; i < node.m_children.size(); i++)
-                _construct_string(str, node.m_children[i], indent + 2);
+            for (std::size_t i = 0; i < children.size(); i++)
+                _construct_string(str, children[i], indent + 2);
         }
     }
     else
     {
-        for (std::size_t i = 0; i < node.m_children.size(); i++)
-            _construct_string(str, node.m_children[i], indent);
+        for (std::size_t i = 0; i < children.size(); i++)
+            _construct_string(str, children[i], indent);
     }
 }
 
-bool Node::_write_node(std::FILE* file, const Node& node, std::size_t indent)
+// Only worth replacing with an alias when it is longer than the alias itself
+static bool _is_duplicate_candidate(const Node& node)
 {
-    char str_indent[1024];
-    for (std::size_t i = 0; i < indent; i++)
-        str_indent[i] = ' ';
-    str_indent[indent] = '\0';
+    return !node.get_children().empty() || node.get_value().size() > 16;
+}
 
-    // write node with value into file
-    if (node.get_value().size() > 0)
-    {
-        std::fputs(
-            std::string(str_indent + node.get_name() + ": " + node.get_value() + "\n").c_str(), file
-        );
-    }
-    else
+bool Node::_write_children(WriteContext& context) const
+{
+    if (context.deduplicate)
+        _count_duplicates(context.counts, *this);
+
+    const std::vector<Node>& children = get_children();
+    for (std::size_t i = 0; i < children.size(); i++)
     {
-        std::fputs(std::string(str_indent + node.get_name() + ":\n").c_str(), file);
-        for (std::size_t i = 0; i < node.m_children.size(); i++)
-        {
-            bool result = _write_node(file, node.m_children[i], indent + 2);
-            if (!result)
-                return false;
-        }
+        bool result = _write_node(context, children[i], 0);
+        if (!result)
+            return false;
     }
 
-    return true;
+    // NOTE: file is null when only building the string
+    std::string& str = context.str;
+    if (context.file == nullptr)
+        return true;
+
+    _YAML_STATS(_record_write(str.size()));
+    return std::fwrite(str.data(), 1, str.size(), context.file) == str.size();
 }
 
-void Node::_read_node(std::FILE* file, Node* last, std::size_t last_indent_size)
+void Node::_count_duplicates(
+    std::unordered_map<std::uint64_t, std::size_t>& counts, const Node& node
+)
+{
+    for (const Node& child : node.get_children())
+    {
+        // anything within a duplicate is written once at most, so only count its first copy
+        if (_is_duplicate_candidate(child) && ++counts[child._get_content_hash()] > 1)
+            continue;
+        if (child.m_shared == nullptr)
+            _count_duplicates(counts, child);
+    }
+}
+
+void Node::_share_duplicates(
+    Node& node, const std::unordered_map<std::uint64_t, std::size_t>& counts,
+    std::unordered_multimap<std::uint64_t, std::shared_ptr<const Node>>& shared
+)
+{
+    for (Node& child : node.m_children)
+    {
+        if (child.m_shared != nullptr)
+            continue;
+
+        std::uint64_t hash = child._get_content_hash();
+        auto count = counts.find(hash);
+        if (!_is_duplicate_candidate(child) || count == counts.end() || count->second < 2)
+        {
+            _share_duplicates(child, counts, shared);
+            continue;
+        }
+
+        // NOTE: nodes with the same hash are only shared after a full comparison, in case of a
+        // collision
+        auto [first, last] = shared.equal_range(hash);
+        auto existing = std::find_if(
+            first, last, [&](const auto& entry) { return _equal_content(*entry.second, child); }
+        );
+
+        if (existing == last)
+        {
+            _share_duplicates(child, counts, shared);
+            shared.emplace(hash, child.share(child.m_name));
+        }
+        else
+        {
+            // NOTE: the content hash stays the same, so there is nothing to invalidate
+            child.m_value = std::string();
+            child.m_children = std::vector<Node>();
+            child.m_shared = existing->second;
+        }
+    }
+}
+
+static void _repack_string(std::string& str)
+{
+    if (str.capacity() > std::string().capacity())
+        str = std::string(str.data(), str.size());
+}
+
+void Node::_compact(Node& node)
+{
+    _repack_string(node.m_name);
+    _repack_string(node.m_value);
+
+    // NOTE: allocated parent first then each subtree in turn, so a subtree is close together
+    std::vector<Node> children = {};
+    children.reserve(node.m_children.size());
+    for (Node& child : node.m_children)
+        children.push_back(std::move(child));
+
+    node.m_children = std::move(children);
+    node._relink_children();
+
+    for (Node& child : node.m_children)
+        _compact(child);
+}
+
+void compact(Node& node, const CompactOptions& options)
+{
+    if (options.share_duplicates)
+    {
+        std::unordered_map<std::uint64_t, std::size_t> counts = {};
+        std::unordered_multimap<std::uint64_t, std::shared_ptr<const Node>> shared = {};
+        Node::_count_duplicates(counts, node);
+        Node::_share_duplicates(node, counts, shared);
+    }
+
+    Node::_compact(node);
+}
+
+template<typename _Node>
+static void _parallel_for_each(
+    _Node& node, std::size_t depth, const std::function<void(_Node&)>& fn,
+    std::size_t thread_count
+)
+{
+    // NOTE: going through get_children() clears the cached hashes above the split level here, so
+    // workers changing their subtree only read them rather than racing to clear them
+    std::vector<_Node*> subtrees = {&node};
+    for (std::size_t level = 0; level < std::max<std::size_t>(depth, 1); level++)
+    {
+        std::vector<_Node*> next = {};
+        for (_Node* parent : subtrees)
+        {
+            if (level > 0)
+                fn(*parent);
+            for (_Node& child : parent->get_children())
+                next.push_back(&child);
+        }
+        subtrees = std::move(next);
+    }
+
+    if (thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    thread_count = std::min(thread_count, subtrees.size());
+
+    std::atomic<std::size_t> next_index = 0;
+    std::exception_ptr error = nullptr;
+    std::mutex error_mutex = {};
+
+    // NOTE: keeps the first exception to rethrow on the calling thread, and stops the workers
+    // taking any more subtrees
+    auto fail = [&]()
+    {
+        std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(error_mutex);
+        if (error == nullptr)
+            error = std::current_exception();
+        next_index = subtrees.size();
+    };
+
+    auto worker = [&]()
+    {
+        try
+        {
+            for (std::size_t i = next_index++; i < subtrees.size(); i = next_index++)
+            {
+                fn(*subtrees[i]);
+                for (_Node& child : subtrees[i]->depth_first())
+                    fn(child);
+            }
+        }
+        catch (...)
+        {
+            fail();
+        }
+    };
+
+    std::vector<std::thread> threads = {};
+    threads.reserve(thread_count);
+    try
+    {
+        for (std::size_t i = 1; i < thread_count; i++)
+            threads.emplace_back(worker);
+    }
+    catch (const std::system_error&)
+    {
+        // NOTE: the threads that did start and this one still share all of the work
+    }
+
+    // the calling thread does its share rather than just waiting
+    worker();
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    if (error != nullptr)
+        std::rethrow_exception(error);
+}
+
+void parallel_for_each(
+    Node& node, std::size_t depth, const std::function<void(Node&)>& fn, std::size_t thread_count
+)
+{
+    _parallel_for_each(node, depth, fn, thread_count);
+}
+
+void parallel_for_each(
+    const Node& node, std::size_t depth, const std::function<void(const Node&)>& fn,
+    std::size_t thread_count
+)
+{
+    _parallel_for_each(node, depth, fn, thread_count);
+}
+
+// Fewer children than this are searched linearly, as building a hash table would cost more
+static constexpr std::size_t s_hashed_lookup_size = 16;
+
+static void _build_index(
+    const std::vector<Node>& children, std::unordered_map<std::string_view, std::size_t>& index
+)
+{
+    index.reserve(children.size());
+    for (std::size_t i = 0; i < children.size(); i++)
+    {
+        // keeps the first of any duplicate names, same as Node::exists()
+        index.emplace(children[i].get_name(), i);
+    }
+}
+
+void merge(Node& base, const Node& overlay, MergePolicy policy)
+{
+    const std::vector<Node>& children = overlay.get_children();
+    if (children.empty())
+        return;
+
+    // NOTE: matched before anything is added, as adding can move the names the index points at
+    std::vector<std::size_t> matches = std::vector<std::size_t>(children.size(), Node::null_index);
+    const std::vector<Node>& base_children = std::as_const(base).get_children();
+    if (base_children.size() >= s_hashed_lookup_size && children.size() > 1)
+    {
+        std::unordered_map<std::string_view, std::size_t> index = {};
+        _build_index(base_children, index);
+        for (std::size_t i = 0; i < children.size(); i++)
+        {
+            auto match = index.find(children[i].get_name());
+            if (match != index.end())
+                matches[i] = match->second;
+        }
+    }
+    else
+    {
+        for (std::size_t i = 0; i < children.size(); i++)
+            matches[i] = base.exists(children[i].get_name());
+    }
+
+    for (std::size_t i = 0; i < children.size(); i++)
+    {
+        const Node& child = children[i];
+        if (matches[i] == Node::null_index)
+        {
+            base.push_back(child);
+            continue;
+        }
+
+        const Node& target = std::as_const(base).get_children()[matches[i]];
+        bool both_have_children = !child.empty() && !target.empty();
+
+        if (policy == MergePolicy::Replace || (policy == MergePolicy::Deep && !both_have_children))
+            base.get_child(matches[i]) = child;
+        else if (both_have_children)
+            merge(base.get_child(matches[i]), child, policy);
+    }
+}
+
+LayeredView::LayeredView(std::vector<const Node*> layers) : m_layers(std::move(layers)) {}
+
+void LayeredView::push_layer(const Node& layer)
+{
+    m_layers.push_back(&layer);
+
+    // NOTE: the cache is keyed by node address and never shrinks, so a new one is started rather
+    // than keeping indexes of nodes that may have been freed since
+    m_cache = std::make_shared<IndexCache>();
+}
+
+std::size_t LayeredView::_find(const Node& node, const std::string& field_name) const
+{
+    const std::vector<Node>& children = node.get_children();
+    if (children.size() < s_hashed_lookup_size)
+        return node.exists(field_name);
+
+    {
+        std::shared_lock<std::shared_mutex> lock =
+            std::shared_lock<std::shared_mutex>(m_cache->mutex);
+        auto cached = m_cache->indexes.find(&node);
+        if (cached != m_cache->indexes.end())
+        {
+            auto match = cached->second.find(field_name);
+            return match != cached->second.end() ? match->second : Node::null_index;
+        }
+    }
+
+    // NOTE: built without the lock held, if another thread gets there first its index is kept
+    std::unordered_map<std::string_view, std::size_t> index = {};
+    _build_index(children, index);
+
+    std::unique_lock<std::shared_mutex> lock = std::unique_lock<std::shared_mutex>(m_cache->mutex);
+    const auto& cached = m_cache->indexes.try_emplace(&node, std::move(index)).first->second;
+    auto match = cached.find(field_name);
+    return match != cached.end() ? match->second : Node::null_index;
+}
+
+bool LayeredView::exists(const std::string& field_name) const
+{
+    for (const Node* layer : m_layers)
+    {
+        if (_find(*layer, field_name) != Node::null_index)
+            return true;
+    }
+    return false;
+}
+
+LayeredView LayeredView::get_child(const std::string& field_name) const
+{
+    LayeredView view = {};
+    view.m_cache = m_cache;
+
+    for (std::size_t i = m_layers.size(); i > 0; i--)
+    {
+        const Node& layer = *m_layers[i - 1];
+        std::size_t index = _find(layer, field_name);
+        if (index == Node::null_index)
+            continue;
+
+        const Node& child = layer.get_children()[index];
+        view.m_layers.push_back(&child);
+        if (child.empty())
+            break;
+    }
+
+    assert(!view.m_layers.empty() && "YAML ASSERT: failed to find child node");
+    std::reverse(view.m_layers.begin(), view.m_layers.end());
+    return view;
+}
+
+std::vector<std::string> LayeredView::get_child_names() const
+{
+    std::vector<std::string> names = {};
+    std::unordered_set<std::string_view> seen = {};
+
+    // NOTE: a layer with a value hides the children of the layers below it
+    std::size_t bottom = m_layers.size();
+    while (bottom > 0 && !m_layers[bottom - 1]->empty())
+        bottom--;
+
+    for (std::size_t i = bottom; i < m_layers.size(); i++)
+    {
+        for (const Node& child : m_layers[i]->get_children())
+        {
+            if (seen.insert(child.get_name()).second)
+                names.push_back(child.get_name());
+        }
+    }
+    return names;
+}
+
+const std::string& LayeredView::get_value() const
+{
+    static const std::string empty = {};
+    return m_layers.empty() ? empty : m_layers.back()->get_value();
+}
+
+Node LayeredView::to_node() const
+{
+    if (m_layers.empty())
+        return Node();
+
+    Node node = *m_layers.front();
+    for (std::size_t i = 1; i < m_layers.size(); i++)
+    {
+        const Node& layer = *m_layers[i];
+        if (layer.empty() || node.empty())
+            node = layer;
+        else
+            merge(node, layer);
+    }
+    return node;
+}
+
+static std::string_view _trim(std::string_view str)
+{
+    while (!str.empty() && str.front() == ' ')
+        str.remove_prefix(1);
+    while (!str.empty() && str.back() == ' ')
+        str.remove_suffix(1);
+    return str;
+}
+
+static bool _is_quoted(std::string_view value)
+{
+    return value.size() >= 2 && value.front() == '"' && value.back() == '"';
+}
+
+template<typename _T>
+static bool _parse_number(std::string_view value, _T& result)
+{
+    const char* end = value.data() + value.size();
+    std::from_chars_result parsed = std::from_chars(value.data(), end, result);
+    return parsed.ec == std::errc() && parsed.ptr == end;
+}
+
+static bool _check_scalar(
+    detail::ValueKind kind, const detail::ValueRule& rule, std::string_view value
+)
+{
+    switch (kind)
+    {
+    case detail::ValueKind::Any:
+    case detail::ValueKind::Sequence:
+        return true;
+    case detail::ValueKind::Text:
+        return !value.empty();
+    case detail::ValueKind::String:
+        return _is_quoted(value);
+    case detail::ValueKind::Character:
+        return _is_quoted(value) && value.size() == 3;
+    case detail::ValueKind::Bool:
+        return value == "true" || value == "false";
+    case detail::ValueKind::Integer:
+    {
+        std::int64_t result = 0;
+        return _parse_number(value, result) && result >= rule.min &&
+               (result < 0 || static_cast<std::uint64_t>(result) <= rule.max);
+    }
+    case detail::ValueKind::Unsigned:
+    {
+        std::uint64_t result = 0;
+        return _parse_number(value, result) && result <= rule.max;
+    }
+    case detail::ValueKind::Float:
+    {
+        double result = 0;
+        return _parse_number(value, result);
+    }
+    }
+    return false;
+}
+
+static bool _check_rule(const detail::ValueRule& rule, std::string_view value, ViolationType& type)
+{
+    type = ViolationType::WrongType;
+    if (rule.kind != detail::ValueKind::Sequence)
+        return _check_scalar(rule.kind, rule, value);
+
+    if (value.size() < 2 || value.front() != '[' || value.back() != ']')
+        return false;
+
+    std::string_view contents = value.substr(1, value.size() - 2);
+    std::size_t length = 0;
+    std::size_t begin = 0;
+    bool quoted = false;
+
+    for (std::size_t i = 0; i <= contents.size(); i++)
+    {
+        if (i < contents.size() && contents[i] == '"')
+            quoted = !quoted;
+        if (i < contents.size() && (quoted || contents[i] != ','))
+            continue;
+
+        std::string_view element = _trim(contents.substr(begin, i - begin));
+        begin = i + 1;
+
+        // an empty sequence, "[]"
+        if (element.empty() && length == 0 && i == contents.size())
+            break;
+
+        length++;
+        if (!_check_scalar(rule.element, rule, element))
+            return false;
+    }
+
+    type = ViolationType::WrongLength;
+    return length >= rule.min_length && length <= rule.max_length;
+}
+
+Schema& Schema::_add(const std::string& path, const detail::ValueRule& rule, bool required)
+{
+    Rule added = Rule{{}, rule, required};
+    for (std::size_t begin = 0; begin < path.size();)
+    {
+        std::size_t end = std::min(path.find('/', begin), path.size());
+        if (end > begin)
+            added.path.push_back(path.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    m_rules.push_back(std::move(added));
+    m_compiled.store(false);
+    return *this;
+}
+
+Schema::Schema(const Schema& other) : m_rules(other.m_rules) {}
+
+Schema& Schema::operator=(const Schema& other)
+{
+    if (this != &other)
+    {
+        m_rules = other.m_rules;
+        m_compiled.store(false);
+    }
+    return *this;
+}
+
+void Schema::_compile() const
+{
+    if (m_compiled.load(std::memory_order_acquire))
+        return;
+
+    std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(m_compile_mutex);
+    if (m_compiled.load(std::memory_order_relaxed))
+        return;
+
+    // NOTE: built from every rule at once, as a wildcard applies to fields named by rules added
+    // after it as well. Applying a rule can add fields that the other rules' wildcards then apply
+    // to, so this repeats until nothing new is added
+    m_entries = std::vector<Entry>(1);
+    for (std::size_t count = 0; count != m_entries.size();)
+    {
+        count = m_entries.size();
+        for (std::size_t rule = 0; rule < m_rules.size(); rule++)
+            _apply(rule);
+    }
+    m_compiled.store(true, std::memory_order_release);
+}
+
+std::size_t Schema::_add_entry(std::size_t parent, const std::string& name) const
+{
+    // NOTE: indices rather than references, as adding an entry can move the others
+    std::size_t child = m_entries.size();
+    m_entries.push_back(Entry{name});
+    if (name == "*")
+        m_entries[parent].wildcard = child;
+    else
+        m_entries[parent].children.emplace(name, child);
+    return child;
+}
+
+void Schema::_apply(std::size_t rule_index) const
+{
+    const Rule& rule = m_rules[rule_index];
+    std::vector<std::size_t> current = {0};
+    for (const std::string& name : rule.path)
+    {
+        std::vector<std::size_t> next = {};
+        for (std::size_t entry : current)
+        {
+            if (name == "*")
+            {
+                if (m_entries[entry].wildcard == std::string::npos)
+                    _add_entry(entry, name);
+
+                next.push_back(m_entries[entry].wildcard);
+                for (const auto& [child_name, child] : m_entries[entry].children)
+                    next.push_back(child);
+                continue;
+            }
+
+            auto found = m_entries[entry].children.find(name);
+            std::size_t child = found != m_entries[entry].children.end() ? found->second
+                                                                          : _add_entry(entry, name);
+
+            // a field matched by "*" can't be missing, so only named fields are required
+            if (rule.required && m_entries[child].required_slot == std::string::npos)
+            {
+                m_entries[child].required_slot = m_entries[entry].required_children.size();
+                m_entries[entry].required_children.push_back(child);
+            }
+            next.push_back(child);
+        }
+        current = std::move(next);
+    }
+
+    // NOTE: applied again on every pass of _compile(), so each rule is only added once
+    for (std::size_t entry : current)
+    {
+        std::vector<std::size_t>& rules = m_entries[entry].rules;
+        if (std::find(rules.begin(), rules.end(), rule_index) == rules.end())
+            rules.push_back(rule_index);
+    }
+}
+
+std::size_t Schema::_match(const Entry& entry, const std::string& field_name) const
+{
+    auto child = entry.children.find(field_name);
+    return child != entry.children.end() ? child->second : entry.wildcard;
+}
+
+bool Schema::_check_rules(const Entry& entry, std::string_view value, ViolationType& type) const
+{
+    // only the first rule the value breaks is reported, so a field is listed once at most
+    for (std::size_t rule : entry.rules)
+    {
+        if (!_check_rule(m_rules[rule].value, value, type))
+            return false;
+    }
+    return true;
+}
+
+void Schema::_add_missing(
+    std::size_t entry, const std::vector<bool>& seen, const std::string& path,
+    std::vector<Violation>& violations
+) const
+{
+    const std::vector<std::size_t>& required = m_entries[entry].required_children;
+    for (std::size_t i = 0; i < required.size(); i++)
+    {
+        if (seen[i])
+            continue;
+
+        const std::string& name = m_entries[required[i]].name;
+        std::string missing = path.empty() ? name : path + "/" + name;
+        violations.push_back(Violation{ViolationType::Missing, std::move(missing)});
+    }
+}
+
+std::vector<Violation> Schema::validate(const Node& node) const
+{
+    _compile();
+    std::vector<Violation> violations = {};
+    std::string path = {};
+    _validate_node(node, 0, path, violations);
+    return violations;
+}
+
+void Schema::_validate_node(
+    const Node& node, std::size_t entry, std::string& path, std::vector<Violation>& violations
+) const
+{
+    std::vector<bool> seen = std::vector<bool>(m_entries[entry].required_children.size());
+    for (const Node& child : node.get_children())
+    {
+        std::size_t match = _match(m_entries[entry], child.get_name());
+        if (match == std::string::npos)
+            continue;
+
+        const Entry& schema = m_entries[match];
+        if (schema.required_slot != std::string::npos)
+            seen[schema.required_slot] = true;
+
+        std::size_t path_size = path.size();
+        if (!path.empty())
+            path += '/';
+        path += child.get_name();
+
+        ViolationType type = ViolationType::Missing;
+        if (!_check_rules(schema, child.get_value(), type))
+            violations.push_back(Violation{type, path});
+
+        if (!schema.children.empty() || schema.wildcard != std::string::npos)
+            _validate_node(child, match, path, violations);
+        path.resize(path_size);
+    }
+
+    _add_missing(entry, seen, path, violations);
+}
+
+ParseResult Schema::validate_file(
+    const std::string& filename, std::vector<Violation>& violations, const ParseOptions& options
+) const
+{
+    _compile();
+    std::FILE* file = std::fopen(filename.c_str(), "r");
+    if (file == nullptr)
+        return ParseResult{ParseStatus::FileNotFound};
+
+    // one per field the current line is nested within, entry is npos for fields without rules
+    struct Frame
+    {
+        std::size_t indent = 0;
+        std::size_t entry = std::string::npos;
+        std::vector<bool> seen = {};
+        std::size_t path_size = 0;
+    };
+
+    std::string path = {};
+    std::vector<Frame> frames = {};
+    frames.push_back(Frame{0, 0, std::vector<bool>(m_entries[0].required_children.size())});
+
+    auto close_frame = [&]()
+    {
+        Frame& frame = frames.back();
+        if (frame.entry != std::string::npos)
+            _add_missing(frame.entry, frame.seen, path, violations);
+        path.resize(frame.path_size);
+        frames.pop_back();
+    };
+
+    Reader reader = Reader(file, options);
+    while (reader.next())
+    {
+        while (frames.size() > 1 && reader.get_indent() <= frames.back().indent)
+            close_frame();
+
+        std::string name = std::string(reader.get_name());
+        std::string value = reader.get_value();
+        Frame& parent = frames.back();
+        std::size_t match = parent.entry;
+        if (parent.entry != std::string::npos)
+            match = _match(m_entries[parent.entry], name);
+
+        std::size_t path_size = path.size();
+        if (!path.empty())
+            path += '/';
+        path += name;
+
+        bool alias = !value.empty() && value[0] == '*';
+        if (!value.empty() && value[0] == '&')
+            value.erase(0, std::min(value.find(' '), value.size() - 1) + 1);
+
+        if (match != std::string::npos)
+        {
+            const Entry& schema = m_entries[match];
+            if (schema.required_slot != std::string::npos)
+                parent.seen[schema.required_slot] = true;
+
+            ViolationType type = ViolationType::Missing;
+            if (!alias && !_check_rules(schema, value, type))
+                violations.push_back(Violation{type, path});
+        }
+
+        // NOTE: what an alias points at isn't known without building the tree, so nothing below it
+        // is checked
+        std::size_t entry = alias ? std::string::npos : match;
+        std::size_t required = 0;
+        if (entry != std::string::npos)
+            required = m_entries[entry].required_children.size();
+        frames.push_back(Frame{reader.get_indent(), entry, std::vector<bool>(required), path_size});
+    }
+    std::fclose(file);
+
+    if (reader.get_status() != ParseStatus::Success)
+        return ParseResult{reader.get_status(), reader.get_line()};
+
+    while (!frames.empty())
+        close_frame();
+    return ParseResult{};
+}
+
+Node StaticNode::to_node() const
+{
+    bool has_references = false;
+    Node node = Node(std::string(get_name()), std::string(get_value()));
+    _add_children(node, *this, has_references);
+
+    if (has_references)
+    {
+        std::unordered_map<std::string, std::shared_ptr<const Node>> anchors = {};
+        Node::_resolve_references(node, anchors);
+    }
+    return node;
+}
+
+void StaticNode::_add_children(Node& node, const StaticNode& static_node, bool& has_references)
+{
+    node.m_children.reserve(static_node.size());
+
+    const detail::StaticEntry* entries = static_node.m_entries;
+    for (std::size_t i = entries[static_node.m_index].first_child; i != std::string::npos;
+         i = entries[i].next_sibling)
+    {
+        StaticNode child = StaticNode(entries, static_node.m_chars, i);
+        std::string_view value = child.get_value();
+        has_references = has_references || (!value.empty() && (value[0] == '&' || value[0] == '*'));
+
+        Node& added = node._add_child(Node(std::string(child.get_name()), std::string(value)));
+        _add_children(added, child, has_references);
+    }
+}
+
+MemoryUsage Node::memory_usage() const
+{
+    MemoryUsage usage = {};
+    std::unordered_set<const Node*> visited = {};
+    _add_memory_usage(*this, usage, visited);
+    return usage;
+}
+
+void Node::_add_memory_usage(
+    const Node& node, MemoryUsage& usage, std::unordered_set<const Node*>& visited
+)
+{
+    static const std::size_t small_string_size = std::string().capacity();
+
+    usage.nodes++;
+    if (node.m_name.capacity() > small_string_size)
+    {
+        usage.names += node.m_name.size() + 1;
+        usage.slack += node.m_name.capacity() - node.m_name.size();
+    }
+    if (node.m_value.capacity() > small_string_size)
+    {
+        usage.values += node.m_value.size() + 1;
+        usage.slack += node.m_value.capacity() - node.m_value.size();
+    }
+
+    usage.children += node.m_children.size() * sizeof(Node);
+    usage.slack += (node.m_children.capacity() - node.m_children.size()) * sizeof(Node);
+
+    if (node.m_shared != nullptr && visited.insert(node.m_shared.get()).second)
+    {
+        usage.children += sizeof(Node);
+        _add_memory_usage(*node.m_shared, usage, visited);
+    }
+
+    for (const Node& child : node.m_children)
+        _add_memory_usage(child, usage, visited);
+}
+
+bool Node::_write_node(WriteContext& context, const Node& node, std::size_t indent)
+{
+    std::string& str = context.str;
+    detail::put_indent(str, indent);
+    str += node.get_name();
+    str += ':';
+
+    bool write_contents = true;
+    bool is_duplicate = context.deduplicate && _is_duplicate_candidate(node) &&
+                        context.counts[node._get_content_hash()] > 1;
+
+    if (node.m_shared != nullptr || is_duplicate)
+    {
+        std::uint64_t hash = node._get_content_hash();
+        auto [first, last] = context.anchors.equal_range(hash);
+        auto anchor = std::find_if(
+            first, last,
+            [&](const auto& entry) { return _equal_content(*entry.second.first, node); }
+        );
+
+        if (anchor != last)
+        {
+            str += " *";
+            str += anchor->second.second;
+            write_contents = false;
+        }
+        else
+        {
+            std::string label = node.m_shared != nullptr ? node.m_shared->m_name : "anchor";
+            if (label.empty() || context.labels.contains(label))
+            {
+                std::size_t i = context.labels.size();
+                while (context.labels.contains(label + std::to_string(i)))
+                    i++;
+                label += std::to_string(i);
+            }
+
+            str += " &";
+            str += label;
+            context.labels.insert(label);
+            context.anchors.emplace(hash, std::make_pair(&node, std::move(label)));
+        }
+    }
+
+    // write node with value into file
+    if (write_contents && node.get_value().size() > 0)
+    {
+        str += ' ';
+        str += node.get_value();
+    }
+    str += '\n';
+
+    if (context.file != nullptr && str.size() >= write_buffer_size())
+    {
+        _YAML_STATS(_record_write(str.size()));
+        if (std::fwrite(str.data(), 1, str.size(), context.file) != str.size())
+            return false;
+        str.clear();
+    }
+
+    if (write_contents && node.get_value().size() == 0)
+    {
+        for (const Node& child : node.get_children())
+        {
+            bool result = _write_node(context, child, indent + 2);
+            if (!result)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void Node::_read_node(ParseState& state, Node& root)
 {
     char name[max_name_size()];
     char value[max_value_size()];
-    std::size_t name_size = 0;
-    std::size_t value_size = 0;
-    std::size_t indent_size = 0;
 
-    bool line_not_null = true;
-    while (name_size == 0 && line_not_null)
-        line_not_null = _read_line(file, name, value, name_size, value_size, indent_size);
+    struct Level
+    {
+        Node* node = nullptr;
+        std::size_t indent = 0;
+
+        // NOTE: npos until the first child is read, every child after it must match
+        std::size_t child_indent = std::string::npos;
+    };
+
+    // the nodes from the root down to the last one read, only ancestors of the next node are kept
+    // so adding to the last one's children can't move any of them
+    std::vector<Level> levels = {Level{&root}};
+
+    // NOTE: one line at a time rather than recursing per line, so large files can't overflow the
+    // stack
+    while (true)
+    {
+        std::size_t name_size = 0;
+        std::size_t value_size = 0;
+        std::size_t indent_size = 0;
+
+        bool line_not_null = true;
+        while (name_size == 0 && line_not_null)
+        {
+            indent_size = 0;
+            line_not_null = _read_line(state, name, value, name_size, value_size, indent_size);
+        }
+
+        if (!line_not_null)
+            return;
+
+        if (value[0] == '&' || value[0] == '*')
+            state.has_references = true;
+
+        if (++state.nodes > state.options.max_nodes)
+        {
+            state.status = ParseStatus::TooManyNodes;
+            return;
+        }
+
+        _YAML_STATS(std::uint64_t start = detail::current_stats ? detail::now_ns() : 0);
+
+        while (levels.size() > 1 && levels.back().indent >= indent_size)
+            levels.pop_back();
+
+        Level& parent = levels.back();
+        if (parent.child_indent == std::string::npos)
+            parent.child_indent = indent_size;
+        if (parent.child_indent != indent_size)
+        {
+            state.status = ParseStatus::SyntaxError;
+            return;
+        }
+
+        std::size_t depth = levels.size();
+        if (depth > state.options.max_depth)
+        {
+            state.status = ParseStatus::TooDeep;
+            return;
+        }
+
+        levels.push_back(Level{&parent.node->_add_child(Node(name, value)), indent_size});
+
+#if defined(YAML_STATS)
+        if (Stats* stats = detail::current_stats)
+        {
+            stats->build_ns += detail::now_ns() - start;
+            stats->max_depth = std::max<std::uint64_t>(stats->max_depth, depth);
+        }
+#endif
+    }
+}
+
+void Node::_resolve_references(
+    Node& node, std::unordered_map<std::string, std::shared_ptr<const Node>>& anchors
+)
+{
+    for (Node& child : node.m_children)
+    {
+        const std::string& value = child.m_value;
+        if (value.size() > 1 && value[0] == '&')
+        {
+            // NOTE: anchors within the anchored node are resolved first, as it can't be modified
+            // once it is shared
+            std::size_t end = std::min(value.find(' '), value.size());
+            std::string anchor = value.substr(1, end - 1);
+            child.m_value.erase(0, std::min(end + 1, value.size()));
+
+            _resolve_references(child, anchors);
+            anchors[anchor] = child.share(anchor);
+        }
+        else if (value.size() > 1 && value[0] == '*')
+        {
+            auto anchor = anchors.find(value.substr(1));
+            if (anchor != anchors.end())
+            {
+                child.m_value.clear();
+                child.m_shared = anchor->second;
+            }
+        }
+        else
+            _resolve_references(child, anchors);
+    }
+}
+
+bool Node::_read_line(
+    ParseState& state, char* name, char* value, std::size_t& name_size, std::size_t& value_size,
+    std::size_t& indent_size
+)
+{
+    char line[max_line_size()];
+    _YAML_STATS(std::uint64_t start = detail::current_stats ? detail::now_ns() : 0);
+    if (std::fgets(line, max_line_size(), state.file) == nullptr)
+        return false;
+
+    _YAML_STATS(std::uint64_t read = detail::current_stats ? detail::now_ns() : 0);
+    std::size_t length = static_cast<std::size_t>(strlen(line));
+
+    state.line++;
+    state.bytes += length;
+    if (state.bytes > state.options.max_bytes)
+    {
+        state.status = ParseStatus::TooLarge;
+        return false;
+    }
+
+    // NOTE: fgets stops when the buffer is full, which would otherwise split the line in two
+    if (length > 0 && line[length - 1] != '\n' && !std::feof(state.file))
+    {
+        state.status = ParseStatus::LineTooLong;
+        return false;
+    }
+
+    // one less than the buffers for the null terminator
+    std::size_t max_name = std::min(max_name_size() - 1, state.options.max_scalar_size);
+    std::size_t max_value = std::min(max_value_size() - 1, state.options.max_scalar_size);
+
+    bool finished_intent_count = false;
+    bool finished_line = false;
+    bool fill_value = false;
+    bool fill_anchor = false;
+    std::size_t j = 0;
+
+    for (std::size_t i = 0; i < length; i++)
+    {
+        switch (line[i])
+        {
+        case '\n':
+            finished_line = true;
+            break;
+        case ' ':
+            if (!finished_intent_count)
+                indent_size++;
+            else if (fill_anchor)
+            {
+                // keep the space between an anchor and the value it is given to
+                if (j >= max_value)
+                {
+                    state.status = ParseStatus::ScalarTooLong;
+                    return false;
+                }
+                value[j] = ' ';
+                j++;
+                fill_anchor = false;
+            }
+            continue;
+        case '#': // comments
+            finished_line = true;
+            if (fill_value)
+                value[j] = '\0';
+            else
+            {
+                name[j] = '\0';
+                fill_value = true;
+            }
+            break;
+
+        case '\r':
+            continue;
+
+        default:
+            finished_intent_count = true;
+
+            if (line[i] == ':' && !fill_value)
+            {
+                fill_value = true;
+                name[j] = '\0';
+                name_size = j;
+                j = 0;
+            }
+            else
+            {
+                if (j >= (fill_value ? max_value : max_name))
+                {
+                    state.status = ParseStatus::ScalarTooLong;
+                    return false;
+                }
+
+                if (fill_value && j == 0 && line[i] == '&')
+                    fill_anchor = true;
+
+                if (fill_value)
+                    value[j] = line[i];
+                else
+                    name[j] = line[i];
+                j++;
+            }
+
+            break;
+        }
+
+        if (finished_line)
+            break;
+    }
+
+    if (!fill_value && j > 0)
+    {
+        state.status = ParseStatus::SyntaxError;
+        return false;
+    }
+
+    value[j] = '\0';
+    value_size = j;
+
+#if defined(YAML_STATS)
+    if (Stats* stats = detail::current_stats)
+    {
+        stats->lines++;
+        stats->bytes_read += length;
+        stats->io_ns += read - start;
+        stats->tokenize_ns += detail::now_ns() - read;
+    }
+#endif
+    return true;
+}
+
+bool Reader::next()
+{
+    if (m_pending)
+    {
+        m_pending = false;
+        return true;
+    }
+
+    m_name_size = 0;
+    bool line_not_null = true;
+    while (m_name_size == 0 && line_not_null)
+    {
+        m_value_size = 0;
+        m_indent_size = 0;
+        line_not_null = Node::_read_line(
+            m_state, m_name, m_value, m_name_size, m_value_size, m_indent_size
+        );
+    }
+    return line_not_null;
+}
+
+// Journal log records, one per line:
+//   h <base file size> <base file write time>   header, the base file the log applies to
+//   v <path> <value>                            node value set
+//   s <path> <name size> <name> <value>         node replaced, its children are cleared
+//   a <path> <name size> <name> <value>         child appended to the node
+//   p <path> <count>                            children popped from the node
+// where path is the index of each child from the root down, e.g. "/0/3", or "/" for the root.
+// Names and values are escaped, '\' as "\\" and newlines as "\n", so each record is one line
+
+static void _append_escaped(std::string& record, std::string_view str)
+{
+    for (char c : str)
+    {
+        if (c == '\\')
+            record += "\\\\";
+        else if (c == '\n')
+            record += "\\n";
+        else
+            record += c;
+    }
+}
+
+static std::string _unescape(std::string_view str)
+{
+    std::string result = {};
+    result.reserve(str.size());
+    for (std::size_t i = 0; i < str.size(); i++)
+    {
+        if (str[i] == '\\' && i + 1 < str.size())
+        {
+            i++;
+            result += str[i] == 'n' ? '\n' : str[i];
+        }
+        else
+            result += str[i];
+    }
+    return result;
+}
+
+static std::string _get_path(const Node& node)
+{
+    std::vector<std::size_t> indices = {};
+    for (const Node* current = &node; current->get_parent() != nullptr;
+         current = current->get_parent())
+    {
+        indices.push_back(current - current->get_parent()->get_children().data());
+    }
+
+    if (indices.empty())
+        return "/";
+
+    std::string path = {};
+    for (std::size_t i = indices.size(); i > 0; i--)
+        path += "/" + std::to_string(indices[i - 1]);
+    return path;
+}
+
+static void _append_node_record(
+    std::string& record, char op, const std::string& path, const Node& node
+)
+{
+    std::string name = {};
+    _append_escaped(name, node.get_name());
+
+    record += op;
+    record += ' ' + path + ' ' + std::to_string(name.size()) + ' ' + name + ' ';
+    _append_escaped(record, node.get_value());
+    record += '\n';
+}
+
+static void _append_children_records(std::string& record, const std::string& path, const Node& node)
+{
+    const std::vector<Node>& children = node.get_children();
+    std::string prefix = path.size() > 1 ? path + "/" : path;
+
+    for (std::size_t i = 0; i < children.size(); i++)
+    {
+        _append_node_record(record, 'a', path, children[i]);
+        _append_children_records(record, prefix + std::to_string(i), children[i]);
+    }
+}
+
+void Node::_record(char op, std::size_t count) const
+{
+    Journal* journal = get_root_node(*this).m_journal;
+    if (journal == nullptr)
+        return;
+
+    std::string path = _get_path(*this);
+    std::string record = {};
+
+    switch (op)
+    {
+    case 'v':
+        record = "v " + path + " ";
+        _append_escaped(record, m_value);
+        record += '\n';
+        break;
+    case 's':
+        _append_node_record(record, 's', path, *this);
+        _append_children_records(record, path, *this);
+        break;
+    case 'a':
+    {
+        const Node& child = m_children.back();
+        std::string prefix = path.size() > 1 ? path + "/" : path;
+        _append_node_record(record, 'a', path, child);
+        _append_children_records(record, prefix + std::to_string(m_children.size() - 1), child);
+        break;
+    }
+    case 'p':
+        record = "p " + path + " " + std::to_string(count) + "\n";
+        break;
+    }
+
+    journal->_append(record);
+}
+
+static std::string _get_base_stamp(const std::string& filename)
+{
+    std::error_code error = {};
+    std::uintmax_t size = std::filesystem::file_size(filename, error);
+    if (error)
+        return "0 0";
+
+    auto time = std::filesystem::last_write_time(filename, error);
+    return std::to_string(size) + " " + std::to_string(time.time_since_epoch().count());
+}
+
+// Stops once the record is longer than max_size, leaving what was read so far in record
+static bool _read_record(
+    std::FILE* file, std::string& record,
+    std::size_t max_size = std::numeric_limits<std::size_t>::max()
+)
+{
+    record.clear();
+
+    char buffer[Node::max_line_size()];
+    while (record.size() <= max_size && std::fgets(buffer, sizeof(buffer), file) != nullptr)
+    {
+        record += buffer;
+        if (record.back() == '\n')
+        {
+            record.pop_back();
+            return record.size() <= max_size;
+        }
+    }
+
+    // NOTE: a record without a newline was cut off part way through being written
+    return false;
+}
+
+static bool _read_header(std::FILE* log, const std::string& filename)
+{
+    std::string record = {};
+    return _read_record(log, record, Node::max_line_size()) &&
+           record == "h " + _get_base_stamp(filename);
+}
+
+Journal::Journal(Node& root, const std::string& filename, const JournalOptions& options)
+    : m_root(root), m_filename(filename), m_options(options)
+{
+    std::string log_filename = filename + ".journal";
+    ParseResult parsed = m_root._open_file(filename);
+    bool base_opened = parsed.status == ParseStatus::Success;
+
+    // NOTE: a malformed base file is left alone rather than replaced with an empty tree, without a
+    // log to record into
+    if (!base_opened && parsed.status != ParseStatus::FileNotFound)
+        return;
+
+    std::FILE* log = base_opened ? std::fopen(log_filename.c_str(), "r") : nullptr;
+    Node::ParseState state = {};
+    bool valid = log != nullptr && _read_header(log, filename);
+    bool damaged = valid && !_apply_log(m_root, log, state);
+    if (log != nullptr)
+        std::fclose(log);
+
+    // NOTE: a missing base file is created empty, and a log with a record cut off part way
+    // through can't be appended to, so both start over from the current tree
+    if (!base_opened || damaged)
+        compact();
+    else if (!valid)
+        _start_log();
+    else
+    {
+        m_log = std::fopen(log_filename.c_str(), "a");
+        m_log_size = static_cast<std::size_t>(std::filesystem::file_size(log_filename));
+    }
+
+    if (m_log != nullptr)
+    {
+        m_root.m_journal = this;
+        detail::journal_count++;
+    }
+}
+
+Journal::~Journal()
+{
+    if (m_log == nullptr)
+        return;
+
+    m_root.m_journal = nullptr;
+    detail::journal_count--;
+    std::fclose(m_log);
+}
+
+bool Journal::save()
+{
+    if (m_log == nullptr)
+        return false;
+
+    if (m_log_size > m_options.max_log_size && compact())
+        return true;
+    return std::fflush(m_log) == 0;
+}
+
+// NOTE: the base file has no escapes, so a line break would end the name or value's line early
+static bool _has_line_break(const Node& node)
+{
+    if (node.get_name().find('\n') != std::string::npos ||
+        node.get_value().find('\n') != std::string::npos)
+        return true;
+
+    for (const Node& child : node.get_children())
+    {
+        if (_has_line_break(child))
+            return true;
+    }
+    return false;
+}
+
+bool Journal::compact()
+{
+    if (_has_line_break(m_root))
+        return false;
+    if (!m_root.write_file(m_filename, WriteOptions{.atomic = true}))
+        return false;
+    return _start_log();
+}
+
+ParseResult Journal::open(Node& root, const std::string& filename, const ParseOptions& options)
+{
+    _YAML_STATS(detail::StatsScope scope = detail::StatsScope(StatsPhase::Open));
+    Node::ParseState state = Node::ParseState{nullptr, options};
+    ParseResult result = root._open_file(filename, state);
+    if (!result)
+        return result;
+
+    std::FILE* log = std::fopen((filename + ".journal").c_str(), "r");
+    if (log == nullptr)
+        return result;
+
+    // NOTE: the log is counted on top of the base file, apart from the line the limit was reached
+    // on, which is the record within the log
+    state.line = 0;
+    if (_read_header(log, filename) && !_apply_log(root, log, state) &&
+        state.status != ParseStatus::Success)
+    {
+        root.m_children = std::vector<Node>();
+        root.invalidate_hash();
+        result = ParseResult{state.status, state.line};
+    }
+
+    std::fclose(log);
+    return result;
+}
+
+bool Journal::replay(Node& root, const std::string& filename)
+{
+    std::FILE* log = std::fopen((filename + ".journal").c_str(), "r");
+    if (log == nullptr)
+        return false;
+
+    Node::ParseState state = {};
+    bool valid = _read_header(log, filename);
+    if (valid)
+        _apply_log(root, log, state);
+
+    std::fclose(log);
+    return valid;
+}
+
+void Journal::_append(const std::string& record)
+{
+    std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(m_mutex);
+    if (m_log == nullptr)
+        return;
+
+    std::fwrite(record.data(), 1, record.size(), m_log);
+    m_log_size += record.size();
+}
+
+bool Journal::_start_log()
+{
+    std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(m_mutex);
+    if (m_log != nullptr)
+        std::fclose(m_log);
+
+    std::string header = "h " + _get_base_stamp(m_filename) + "\n";
+    m_log = std::fopen((m_filename + ".journal").c_str(), "w");
+    if (m_log == nullptr)
+        return false;
+
+    m_log_size = std::fwrite(header.data(), 1, header.size(), m_log);
+    return std::fflush(m_log) == 0;
+}
+
+bool Journal::_apply_record(Node& root, const std::string& record, Node::ParseState& state)
+{
+    std::string_view line = record;
+    if (line.size() < 3 || line[1] != ' ')
+        return false;
+
+    std::size_t path_end = std::min(line.find(' ', 2), line.size());
+    std::string_view path = line.substr(2, path_end - 2);
+    std::string_view rest = line.substr(std::min(path_end + 1, line.size()));
+
+    Node* node = &root;
+    node->_unshare();
+    std::size_t depth = 0;
+    for (std::size_t i = 1; i < path.size(); depth++)
+    {
+        std::size_t end = std::min(path.find('/', i), path.size());
+        std::string index_str = std::string(path.substr(i, end - i));
+        std::size_t index = std::strtoull(index_str.c_str(), nullptr, 10);
+        if (index >= node->m_children.size())
+            return false;
+
+        node = &node->m_children[index];
+        node->_unshare();
+        i = end + 1;
+    }
 
-    if (line_not_null)
+    switch (line[0])
     {
-        Node* current = nullptr;
-        if (indent_size == last_indent_size + 2)
+    case 'v':
+        if (rest.size() > state.options.max_scalar_size)
         {
-            last->push_back(Node(name, value));
-            current = &last->m_children.back();
-            current->m_parent = last;
+            state.status = ParseStatus::ScalarTooLong;
+            return false;
         }
-        else
+
+        node->m_value = _unescape(rest);
+        node->invalidate_hash();
+        return true;
+    case 'p':
+    {
+        std::size_t count = std::strtoull(std::string(rest).c_str(), nullptr, 10);
+        if (count > node->m_children.size())
+            return false;
+
+        node->m_children.resize(node->m_children.size() - count);
+        node->invalidate_hash();
+        return true;
+    }
+    case 's':
+    case 'a':
+    {
+        std::size_t size_end = rest.find(' ');
+        if (size_end == std::string_view::npos)
+            return false;
+
+        std::size_t name_size =
+            std::strtoull(std::string(rest.substr(0, size_end)).c_str(), nullptr, 10);
+        if (size_end + 1 + name_size + 1 > rest.size())
+            return false;
+
+        std::string name = _unescape(rest.substr(size_end + 1, name_size));
+        std::string value = _unescape(rest.substr(size_end + 1 + name_size + 1));
+        if (name.size() > state.options.max_scalar_size ||
+            value.size() > state.options.max_scalar_size)
         {
-            std::size_t diff = last_indent_size - indent_size;
-            for (std::size_t i = 0; i < diff; i += 2)
-                last = last->m_parent;
+            state.status = ParseStatus::ScalarTooLong;
+            return false;
+        }
 
-            if (last->m_parent != nullptr)
+        if (line[0] == 'a')
+        {
+            if (++state.nodes > state.options.max_nodes)
             {
-                last->m_parent->push_back(Node(name, value));
-                current = &last->m_parent->m_children.back();
-                current->m_parent = last->m_parent;
+                state.status = ParseStatus::TooManyNodes;
+                return false;
             }
-            else
+            if (depth + 1 > state.options.max_depth)
             {
-                // at the root node
-                last->push_back(Node(name, value));
-                current = &last->m_children.back();
-                current->m_parent = last;
+                state.status = ParseStatus::TooDeep;
+                return false;
             }
+
+            node->_add_child(Node(name, value));
+            return true;
         }
-        _read_node(file, current, indent_size);
+
+        node->m_name = std::move(name);
+        node->m_value = std::move(value);
+        node->m_children.clear();
+        node->invalidate_hash();
+        return true;
     }
+    }
+
+    return false;
 }
 
-bool Node::_read_line(
-    std::FILE* file, char* name, char* value, std::size_t& name_size, std::size_t& value_size,
-    std::size_t& indent_size
-)
+bool Journal::_apply_log(Node& root, std::FILE* log, Node::ParseState& state)
 {
-    char line[max_line_size()];
-    if (std::fgets(line, max_line_size(), file) != nullptr)
+    std::string record = {};
+    while (true)
     {
-        std::size_t length = static_cast<std::size_t>(strlen(line));
+        std::size_t max_bytes = state.options.max_bytes;
+        std::size_t remaining = state.bytes < max_bytes ? max_bytes - state.bytes - 1 : 0;
+        if (!_read_record(log, record, remaining))
+        {
+            if (record.size() > remaining)
+            {
+                state.status = ParseStatus::TooLarge;
+                state.line++;
+            }
+            break;
+        }
+
+        state.line++;
+        state.bytes += record.size() + 1;
+        if (!_apply_record(root, record, state))
+            return false;
+    }
+    return record.empty();
+}
+
+static std::int64_t _get_write_time(const std::string& filename)
+{
+    std::error_code error = {};
+    auto time = std::filesystem::last_write_time(filename, error);
+    return error ? 0 : static_cast<std::int64_t>(time.time_since_epoch().count());
+}
 
-        bool finished_intent_count = false;
-        bool finished_line = false;
-        bool fill_value = false;
-        std::size_t j = 0;
+static bool _read_file(const std::string& filename, std::string& contents)
+{
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    char buffer[4096];
+    contents.clear();
+    for (std::size_t size = 0; (size = std::fread(buffer, 1, sizeof(buffer), file)) > 0;)
+        contents.append(buffer, size);
+
+    std::fclose(file);
+    return true;
+}
+
+static std::FILE* _open_memory(char* data, std::size_t size)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    return fmemopen(data, size, "r");
+#else
+    std::FILE* file = std::tmpfile();
+    if (file != nullptr)
+    {
+        std::fwrite(data, 1, size, file);
+        std::rewind(file);
+    }
+    return file;
+#endif
+}
 
-        for (std::size_t i = 0; i < length; i++)
+WatchedDocument::WatchedDocument(const std::string& filename) : m_filename(filename)
+{
+#if defined(__linux__)
+    // NOTE: watches the directory as editors often save by replacing the file rather than
+    // writing into it
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd >= 0)
+    {
+        std::filesystem::path path = std::filesystem::path(filename);
+        std::string directory = path.has_parent_path() ? path.parent_path().string() : ".";
+        m_watch = inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (m_watch < 0)
         {
-            switch (line[i])
-            {
-            case '\n':
-                finished_line = true;
-                break;
-            case ' ':
-                if (!finished_intent_count)
-                    indent_size++;
-                continue;
-            case '#': // comments
-                finished_line = true;
-                if (fill_value)
-                    value[j] = '\0';
-                else
-                {
-                    name[j] = '\0';
-                    fill_value = true;
-                }
-                break;
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+#endif
 
-            case '\r':
-                continue;
+    m_write_time = _get_write_time(filename);
+    _reload(false);
+}
 
-            default:
-                finished_intent_count = true;
+WatchedDocument::~WatchedDocument()
+{
+#if defined(__linux__)
+    if (m_fd >= 0)
+        ::close(m_fd);
+#endif
+}
 
-                if (line[i] == ':' && !fill_value)
-                {
-                    fill_value = true;
-                    name[j] = '\0';
-                    name_size = j;
-                    j = 0;
-                }
-                else
-                {
-                    if (fill_value)
-                        value[j] = line[i];
-                    else
-                        name[j] = line[i];
-                    j++;
-                }
+bool WatchedDocument::poll()
+{
+    if (!_has_changed())
+        return false;
+    return _reload(true);
+}
 
-                break;
-            }
+bool WatchedDocument::_has_changed()
+{
+#if defined(__linux__)
+    if (m_fd >= 0)
+    {
+        std::string name = std::filesystem::path(m_filename).filename().string();
+        bool changed = false;
 
-            if (finished_line)
+        alignas(inotify_event) char buffer[4096];
+        ssize_t size = 0;
+        while ((size = ::read(m_fd, buffer, sizeof(buffer))) > 0)
+        {
+            for (ssize_t i = 0; i < size;)
             {
-                assert(fill_value && "yaml syntax error, must have a ':' after field name");
-                break;
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + i);
+                if (event->len > 0 && name == event->name)
+                    changed = true;
+                i += sizeof(inotify_event) + event->len;
             }
         }
-        value[j] = '\0';
-        value_size = j;
+        return changed;
+    }
+#endif
 
-        return true;
+    std::int64_t write_time = _get_write_time(m_filename);
+    if (write_time == m_write_time)
+        return false;
+
+    m_write_time = write_time;
+    return true;
+}
+
+bool WatchedDocument::_reload(bool notify)
+{
+    std::string contents = {};
+    if (!_read_file(m_filename, contents))
+        return false;
+
+    // a section starts at every line that isn't indented, empty or a comment
+    std::vector<Section> sections = {};
+    std::vector<std::size_t> offsets = {};
+    for (std::size_t begin = 0; begin < contents.size();)
+    {
+        std::size_t end = std::min(contents.find('\n', begin), contents.size());
+        char c = contents[begin];
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != '#')
+        {
+            std::size_t name_end = std::min(contents.find(':', begin), end);
+            sections.push_back(Section{contents.substr(begin, name_end - begin)});
+            offsets.push_back(begin);
+        }
+        begin = end + 1;
     }
-    return false;
+    offsets.push_back(contents.size());
+
+    for (std::size_t i = 0; i < sections.size(); i++)
+    {
+        std::size_t size = offsets[i + 1] - offsets[i];
+        sections[i].hash = detail::hash_str(std::string_view(contents).substr(offsets[i], size));
+    }
+
+    std::vector<Change> changes = {};
+
+    for (const Section& old_section : m_sections)
+    {
+        bool removed = std::none_of(
+            sections.begin(), sections.end(),
+            [&](const Section& section) { return section.name == old_section.name; }
+        );
+        std::size_t index = m_root.exists(old_section.name);
+        if (removed && index != Node::null_index)
+        {
+            m_root.get_children().erase(m_root.get_children().begin() + index);
+            changes.push_back(Change{ChangeType::Removed, old_section.name});
+        }
+    }
+
+    // where the next added section goes, after the section before it in the file
+    std::size_t position = 0;
+
+    for (std::size_t i = 0; i < sections.size(); i++)
+    {
+        const Section& section = sections[i];
+        std::size_t index = m_root.exists(section.name);
+        if (index != Node::null_index)
+            position = index + 1;
+
+        auto old_section = std::find_if(
+            m_sections.begin(), m_sections.end(),
+            [&](const Section& other) { return other.name == section.name; }
+        );
+        if (old_section != m_sections.end() && old_section->hash == section.hash)
+            continue;
+
+        Node parsed = {};
+        std::FILE* file = _open_memory(contents.data() + offsets[i], offsets[i + 1] - offsets[i]);
+        if (file == nullptr)
+            continue;
+        Node::ParseState state = Node::ParseState{file};
+        Node::_read_node(state, parsed);
+        std::fclose(file);
+
+        // NOTE: a section that can't be parsed keeps its last good version
+        if (state.status != ParseStatus::Success)
+            continue;
+
+        if (state.has_references)
+            Node::_resolve_references(parsed, m_anchors);
+
+        if (parsed.empty())
+            continue;
+
+        if (index == Node::null_index)
+        {
+            std::vector<Node>& children = m_root.get_children();
+            children.insert(children.begin() + position, std::move(parsed.front()));
+            m_root._relink_children();
+            position++;
+            changes.push_back(Change{ChangeType::Added, section.name});
+        }
+        else
+        {
+            Node& live = m_root.get_children()[index];
+            std::vector<Change> section_changes = diff(live, parsed.front());
+            changes.insert(changes.end(), section_changes.begin(), section_changes.end());
+            live = std::move(parsed.front());
+        }
+    }
+
+    m_sections = std::move(sections);
+
+    if (notify)
+    {
+        for (const Change& change : changes)
+        {
+            for (const Callback& callback : m_callbacks)
+                callback(change);
+        }
+    }
+
+    return !changes.empty();
+}
+
+SharedDocument::Snapshot::~Snapshot()
+{
+    if (m_slot != nullptr)
+        m_slot->store(0, std::memory_order_release);
+}
+
+SharedDocument::SharedDocument(Node root)
+{
+    // NOTE: fill in the hash caches up front, so readers never write into a shared version
+    root.get_hash();
+    std::shared_ptr<const Node> owner = std::make_shared<const Node>(std::move(root));
+    m_current.store(owner.get());
+    m_owner.store(std::move(owner));
+}
+
+SharedDocument::Snapshot SharedDocument::read() const
+{
+    // start looking from a different slot on each thread so readers don't share cache lines
+    std::size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+    for (std::size_t i = start; i < start + max_readers(); i++)
+    {
+        std::atomic<std::uint64_t>& slot = m_readers[i % max_readers()].epoch;
+        std::uint64_t expected = 0;
+        if (slot.load(std::memory_order_relaxed) == 0 &&
+            slot.compare_exchange_strong(expected, m_epoch.load()))
+        {
+            return Snapshot(m_current.load(), &slot);
+        }
+    }
+
+    // every slot is held, possibly by this same thread, so spinning could wait forever
+    std::shared_ptr<const Node> owner = m_owner.load();
+    const Node* root = owner.get();
+    return Snapshot(root, nullptr, std::move(owner));
+}
+
+void SharedDocument::publish(Node root)
+{
+    std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(m_write_mutex);
+    _publish(std::move(root));
+}
+
+std::size_t SharedDocument::reclaim()
+{
+    std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(m_write_mutex);
+    return _reclaim();
+}
+
+void SharedDocument::_publish(Node&& root)
+{
+    root.get_hash();
+    std::shared_ptr<const Node> owner = std::make_shared<const Node>(std::move(root));
+    m_current.store(owner.get());
+    std::shared_ptr<const Node> old = m_owner.exchange(std::move(owner));
+
+    // readers that started on this epoch or earlier may still be looking at the old version,
+    // readers without a slot keep it alive through their own reference
+    m_retired.push_back(Retired{std::move(old), m_epoch.fetch_add(1)});
+    _reclaim();
+}
+
+std::size_t SharedDocument::_reclaim()
+{
+    std::uint64_t oldest = UINT64_MAX;
+    for (const ReaderSlot& reader : m_readers)
+    {
+        std::uint64_t epoch = reader.epoch.load();
+        if (epoch != 0)
+            oldest = std::min(oldest, epoch);
+    }
+
+    auto reclaimed = std::remove_if(
+        m_retired.begin(), m_retired.end(),
+        [&](const Retired& retired) { return retired.epoch < oldest; }
+    );
+    m_retired.erase(reclaimed, m_retired.end());
+    return m_retired.size();
+}
+
+AsyncWriter::AsyncWriter() { m_thread = std::thread(&AsyncWriter::_run, this); }
+
+AsyncWriter::~AsyncWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+std::future<bool> AsyncWriter::write(
+    Node root, const std::string& filename, const WriteOptions& options
+)
+{
+    return write(std::make_shared<const Node>(std::move(root)), filename, options);
+}
+
+std::future<bool> AsyncWriter::write(
+    std::shared_ptr<const Node> root, const std::string& filename, const WriteOptions& options
+)
+{
+    std::promise<bool> promise = {};
+    std::future<bool> future = promise.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(m_mutex);
+        auto pending = std::find_if(
+            m_jobs.begin(), m_jobs.end(), [&](const Job& job) { return job.filename == filename; }
+        );
+
+        if (pending != m_jobs.end())
+        {
+            // the older tree was never written, so it's replaced rather than written twice
+            pending->root = std::move(root);
+            pending->options = options;
+            pending->promises.push_back(std::move(promise));
+        }
+        else
+        {
+            m_jobs.push_back(Job{std::move(root), filename, options});
+            m_jobs.back().promises.push_back(std::move(promise));
+        }
+    }
+
+    m_condition.notify_all();
+    return future;
+}
+
+void AsyncWriter::wait()
+{
+    std::unique_lock<std::mutex> lock = std::unique_lock<std::mutex>(m_mutex);
+    m_condition.wait(lock, [&]() { return m_jobs.empty() && !m_busy; });
+}
+
+void AsyncWriter::_run()
+{
+    std::unique_lock<std::mutex> lock = std::unique_lock<std::mutex>(m_mutex);
+    while (true)
+    {
+        m_condition.wait(lock, [&]() { return m_stop || !m_jobs.empty(); });
+        if (m_jobs.empty())
+            return;
+
+        Job job = std::move(m_jobs.front());
+        m_jobs.erase(m_jobs.begin());
+        m_busy = true;
+
+        lock.unlock();
+        bool result = job.root->write_file(job.filename, job.options);
+        for (std::promise<bool>& promise : job.promises)
+            promise.set_value(result);
+        lock.lock();
+
+        m_busy = false;
+        m_condition.notify_all();
+    }
+}
+
+static AsyncWriter& _get_async_writer()
+{
+    static AsyncWriter writer = {};
+    return writer;
+}
+
+std::future<bool> write_async(
+    const Node& node, const std::string& filename, const WriteOptions& options
+)
+{
+    return _get_async_writer().write(get_root_node(node), filename, options);
+}
+
+std::future<bool> write_async(Node&& root, const std::string& filename, const WriteOptions& options)
+{
+    assert(
+        root.get_parent() == nullptr &&
+        "YAML ASSERT: only a root node can be moved into a background write"
+    );
+    return _get_async_writer().write(std::move(root), filename, options);
+}
+
+std::future<bool> write_async(
+    std::shared_ptr<const Node> root, const std::string& filename, const WriteOptions& options
+)
+{
+    return _get_async_writer().write(std::move(root), filename, options);
 }
 
 Node& get_root_node(Node& node)
 {
-    while (node.get_parent() != nullptr)
-        node = *node.get_parent();
-    return node;
+    Node* target = &node;
+    while (target->get_parent() != nullptr)
+        target = target->get_parent();
+    return *target;
 }
 
 const Node& get_root_node(const Node& node)
 {
     const Node* target = &node;
-    while (node.get_parent() != nullptr)
+    while (target->get_parent() != nullptr)
         target = target->get_parent();
     return *target;
 }
@@ -382,4 +2815,103 @@ Node open(const std::string& filename)
     return node;
 }
 
+static std::size_t _find_child(
+    const Node& node, const std::unordered_map<std::string_view, std::size_t>& index,
+    const std::string& field_name
+)
+{
+    if (node.get_children().size() < s_hashed_lookup_size)
+        return node.exists(field_name);
+
+    auto match = index.find(field_name);
+    return match != index.end() ? match->second : Node::null_index;
+}
+
+static void _diff_node(
+    const Node& before, const Node& after, const std::string& path, std::vector<Change>& changes
+)
+{
+    // NOTE: nodes are only matched up by name, so comparing them compares their contents
+    if (before.get_hash() == after.get_hash() && before.compare(after))
+        return;
+
+    if (before.get_value() != after.get_value())
+        changes.push_back(Change{ChangeType::Modified, path});
+
+    const std::vector<Node>& before_children = before.get_children();
+    const std::vector<Node>& after_children = after.get_children();
+    std::string prefix = path.empty() ? path : path + "/";
+
+    std::unordered_map<std::string_view, std::size_t> before_index = {};
+    std::unordered_map<std::string_view, std::size_t> after_index = {};
+    if (before_children.size() >= s_hashed_lookup_size)
+        _build_index(before_children, before_index);
+    if (after_children.size() >= s_hashed_lookup_size)
+        _build_index(after_children, after_index);
+
+    for (std::size_t i = 0; i < after_children.size(); i++)
+    {
+        const Node& child = after_children[i];
+        std::size_t index = _find_child(before, before_index, child.get_name());
+        if (index == Node::null_index)
+            changes.push_back(Change{ChangeType::Added, prefix + child.get_name()});
+        else
+            _diff_node(before_children[index], child, prefix + child.get_name(), changes);
+    }
+
+    for (std::size_t i = 0; i < before_children.size(); i++)
+    {
+        const Node& child = before_children[i];
+        if (_find_child(after, after_index, child.get_name()) == Node::null_index)
+            changes.push_back(Change{ChangeType::Removed, prefix + child.get_name()});
+    }
+}
+
+std::vector<Change> diff(const Node& before, const Node& after)
+{
+    std::vector<Change> changes = {};
+    _diff_node(before, after, before.get_name(), changes);
+    return changes;
+}
+
+std::vector<OpenResult> open_many(
+    std::span<const std::string> filenames, const OpenOptions& options
+)
+{
+    std::vector<OpenResult> results = std::vector<OpenResult>(filenames.size());
+
+    std::size_t thread_count = options.thread_count;
+    if (thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    thread_count = std::min(thread_count, filenames.size());
+
+    std::atomic<std::size_t> next_index = 0;
+    auto worker = [&]()
+    {
+        for (std::size_t i = next_index++; i < filenames.size(); i = next_index++)
+        {
+            OpenResult& result = results[i];
+            errno = 0;
+            result.parse = result.node.open(filenames[i], options.parse);
+            result.success = static_cast<bool>(result.parse);
+            if (result.parse.status == ParseStatus::FileNotFound)
+                result.error = errno;
+        }
+    };
+
+    std::vector<std::thread> threads = {};
+    threads.reserve(thread_count);
+    for (std::size_t i = 1; i < thread_count; i++)
+        threads.emplace_back(worker);
+
+    // the calling thread does its share rather than just waiting
+    if (thread_count > 0)
+        worker();
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return results;
+}
+
 } // namespace yaml
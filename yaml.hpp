@@ -24,10 +24,31 @@
 #ifndef __YAML_HPP__
 #define __YAML_HPP__
 
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <thread>
+#include <type_traits>
 #include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace yaml {
@@ -83,32 +104,26 @@ struct Convert
  * @class NodeIterator<_Node>
  * @brief Iterator type for iterating over yaml::Node's children nodes
  *
- * @tparam _Node yaml::Node, shouldn't be anything else
+ * @tparam _Node yaml::Node or const yaml::Node
  * @param it iterator type from _Node
  */
 template<typename _Node>
 class NodeIterator
 {
-  public:
-    NodeIterator(std::vector<_Node>::iterator it) : m_it(it) {}
-    NodeIterator(const NodeIterator& other) : m_it(other.m_it) {}
-    NodeIterator(NodeIterator&& other) : m_it(other.m_it) { other.m_it = nullptr; }
+    using _Base = std::conditional_t<
+        std::is_const_v<_Node>, typename std::vector<std::remove_const_t<_Node>>::const_iterator,
+        typename std::vector<std::remove_const_t<_Node>>::iterator>;
 
-    bool operator==(const NodeIterator& other) { return m_it == other.m_it; }
-    bool operator!=(const NodeIterator& other) { return m_it != other.m_it; }
+  public:
+    NodeIterator(_Base it) : m_it(it) {}
+    NodeIterator(const NodeIterator& other) = default;
+    NodeIterator(NodeIterator&& other) = default;
 
-    NodeIterator& operator=(const NodeIterator& other)
-    {
-        m_it == other.m_it;
-        return *this;
-    }
+    bool operator==(const NodeIterator& other) const { return m_it == other.m_it; }
+    bool operator!=(const NodeIterator& other) const { return m_it != other.m_it; }
 
-    NodeIterator& operator=(NodeIterator&& other)
-    {
-        m_it == other.it;
-        other.m_it = nullptr;
-        return *this;
-    }
+    NodeIterator& operator=(const NodeIterator& other) = default;
+    NodeIterator& operator=(NodeIterator&& other) = default;
 
     NodeIterator& operator++()
     {
@@ -136,13 +151,342 @@ class NodeIterator
         return temp;
     }
 
-    _Node& operator*() { return *m_it; }
-    _Node operator->() { return &m_it; }
+    _Node& operator*() const { return *m_it; }
+    _Node* operator->() const { return &*m_it; }
+
+  private:
+    _Base m_it = {};
+};
+
+enum class Traversal
+{
+    DepthFirst,
+    BreadthFirst,
+};
+
+/**
+ * @class TraversalIterator<_Node, _Order>
+ * @brief Iterates over every node below a node, keeping the nodes still to visit in a queue
+ * rather than recursing. Depth first visits a node before its children
+ *
+ * @tparam _Node yaml::Node or const yaml::Node
+ * @tparam _Order Traversal::DepthFirst or Traversal::BreadthFirst
+ */
+template<typename _Node, Traversal _Order>
+class TraversalIterator
+{
+  public:
+    /**
+     * @brief End iterator
+     */
+    TraversalIterator() = default;
+
+    TraversalIterator(_Node& root) { _push_children(root, 0); }
+
+    bool operator==(const TraversalIterator& other) const
+    {
+        return _current() == other._current();
+    }
+
+    bool operator!=(const TraversalIterator& other) const { return !(*this == other); }
+
+    TraversalIterator& operator++()
+    {
+        Pending current = m_pending.front();
+        m_pending.pop_front();
+        _push_children(*current.node, current.depth);
+        return *this;
+    }
+
+    TraversalIterator operator++(int)
+    {
+        TraversalIterator temp = *this;
+        ++(*this);
+        return temp;
+    }
+
+    _Node& operator*() const { return *m_pending.front().node; }
+    _Node* operator->() const { return m_pending.front().node; }
+
+    /**
+     * @brief How far below the node the traversal started from the current node is, its children
+     * being 1
+     */
+    std::size_t get_depth() const { return m_pending.front().depth; }
+
+  private:
+    struct Pending
+    {
+        _Node* node = nullptr;
+        std::size_t depth = 0;
+    };
+
+    _Node* _current() const { return m_pending.empty() ? nullptr : m_pending.front().node; }
+
+    void _push_children(_Node& node, std::size_t depth)
+    {
+        auto& children = node.get_children();
+        if constexpr (_Order == Traversal::DepthFirst)
+        {
+            // NOTE: pushed in reverse so the first child is at the front
+            for (std::size_t i = children.size(); i > 0; i--)
+                m_pending.push_front(Pending{&children[i - 1], depth + 1});
+        }
+        else
+        {
+            for (_Node& child : children)
+                m_pending.push_back(Pending{&child, depth + 1});
+        }
+    }
+
+  private:
+    std::deque<Pending> m_pending = {};
+};
+
+/**
+ * @class TraversalRange<_Node, _Order>
+ * @brief Range over every node below a node, see Node::depth_first() and Node::breadth_first()
+ */
+template<typename _Node, Traversal _Order>
+class TraversalRange
+{
+  public:
+    using Iterator = TraversalIterator<_Node, _Order>;
+
+    TraversalRange(_Node& root) : m_root(&root) {}
+
+    Iterator begin() const { return Iterator(*m_root); }
+    Iterator end() const { return Iterator(); }
 
   private:
-    std::vector<_Node>::iterator m_it = nullptr;
+    _Node* m_root = nullptr;
+};
+
+namespace detail {
+
+    /**
+     * @brief Number of yaml::Journal's currently attached to a tree. Lets nodes skip walking up to
+     * their root to look for a journal to record into when there are none
+     */
+    inline std::atomic<std::size_t> journal_count = 0;
+
+} // namespace detail
+
+/**
+ * @brief True when the library was built with YAML_STATS defined. Without it none of the parse or
+ * emit code is instrumented and yaml::set_stats_sink() does nothing
+ */
+inline constexpr bool stats_enabled()
+{
+#if defined(YAML_STATS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+enum class StatsPhase
+{
+    Open,
+    WriteFile,
+    GetAsString,
+};
+
+/**
+ * @struct Stats
+ * @brief Counters and timings of parsing and emitting files. All times are in nanoseconds
+ */
+struct Stats
+{
+    std::uint64_t bytes_read = 0;
+    std::uint64_t bytes_written = 0;
+    std::uint64_t lines = 0;
+    std::uint64_t nodes_created = 0;
+    std::uint64_t max_depth = 0;
+
+    /**
+     * @brief Estimate of the heap allocations made while building the tree, not a count of real
+     * ones. Counts node names and values too long for the small string buffer and child vectors
+     * that are full when a node is added, which is when they would have to grow
+     */
+    std::uint64_t estimated_allocations = 0;
+
+    // time within Node::open(), split into reading lines from the file, tokenizing them in
+    // _read_line and adding the nodes to the tree
+    std::uint64_t open_ns = 0;
+    std::uint64_t io_ns = 0;
+    std::uint64_t tokenize_ns = 0;
+    std::uint64_t build_ns = 0;
+
+    std::uint64_t write_file_ns = 0;
+    std::uint64_t get_as_string_ns = 0;
+
+    // Node::as<_T>() calls
+    std::uint64_t conversions = 0;
+    std::uint64_t convert_ns = 0;
+
+    Stats& operator+=(const Stats& other);
+};
+
+/**
+ * @brief Called after every instrumented operation with the stats of that operation alone, to
+ * forward them to another metrics system. Can be called from any thread yaml is used on
+ */
+using StatsCallback = std::function<void(StatsPhase phase, const Stats& stats)>;
+
+/**
+ * @brief Accumulates the stats of every following operation into sink and passes them to
+ * callback. Either can be null, set both to null to stop collecting. Only has an effect when
+ * built with YAML_STATS defined, see yaml::stats_enabled()
+ */
+void set_stats_sink(Stats* sink, StatsCallback callback = nullptr);
+
+namespace detail {
+
+#if defined(YAML_STATS)
+    #define _YAML_STATS(...) __VA_ARGS__
+
+    std::uint64_t now_ns();
+    void record_conversion(std::uint64_t start_ns);
+
+    /**
+     * @brief Stats of the operation running on this thread, null outside of one or when there is
+     * no sink to report to
+     */
+    extern thread_local Stats* current_stats;
+
+    /**
+     * @brief Collects the stats of one operation and reports them when it goes out of scope.
+     * Operations started within another are counted as part of the outer one
+     */
+    class StatsScope
+    {
+      public:
+        StatsScope(StatsPhase phase);
+        ~StatsScope();
+
+      private:
+        StatsPhase m_phase = StatsPhase::Open;
+        Stats m_stats = {};
+        Stats* m_previous = nullptr;
+        std::uint64_t m_start = 0;
+    };
+#else
+    #define _YAML_STATS(...)
+#endif
+
+} // namespace detail
+
+struct WriteOptions
+{
+    /**
+     * @brief Leaves the file untouched when its contents already match what would be written
+     */
+    bool skip_unchanged = false;
+
+    /**
+     * @brief Writes into a temporary file first then renames it over the target, so a crash while
+     * writing never leaves a truncated file behind. Each write uses its own temporary file, so
+     * writers racing on the same file never publish each other's partial output. The file keeps
+     * its permissions
+     */
+    bool atomic = false;
+
+    /**
+     * @brief Writes subtrees and values that appear more than once as an anchor the first time and
+     * an alias after that, found by their hash. Shared nodes are always written this way
+     */
+    bool deduplicate = false;
+};
+
+enum class ParseStatus
+{
+    Success,
+    FileNotFound,
+
+    /**
+     * @brief A line has a field name without a ':' after it, or is indented differently to the
+     * fields before it with the same parent
+     */
+    SyntaxError,
+
+    /**
+     * @brief A line is longer than Node::max_line_size()
+     */
+    LineTooLong,
+
+    /**
+     * @brief A name or value is longer than ParseOptions::max_scalar_size, Node::max_name_size() or
+     * Node::max_value_size()
+     */
+    ScalarTooLong,
+
+    TooDeep,
+    TooManyNodes,
+    TooLarge,
+};
+
+/**
+ * @struct ParseOptions
+ * @brief Limits on what a file can make the parser do, for files that can't be trusted. Parsing
+ * stops at the first limit reached and the partly parsed tree is discarded. Aliases count as a
+ * copy of the node they refer to, so aliases of aliases can't get around max_nodes or max_depth
+ */
+struct ParseOptions
+{
+    std::size_t max_depth = std::numeric_limits<std::size_t>::max();
+    std::size_t max_nodes = std::numeric_limits<std::size_t>::max();
+    std::size_t max_bytes = std::numeric_limits<std::size_t>::max();
+    std::size_t max_scalar_size = std::numeric_limits<std::size_t>::max();
+};
+
+struct ParseResult
+{
+    ParseStatus status = ParseStatus::Success;
+
+    /**
+     * @brief Line the error was found on, counting from 1
+     */
+    std::size_t line = 0;
+
+    inline explicit operator bool() const { return status == ParseStatus::Success; }
+};
+
+/**
+ * @struct MemoryUsage
+ * @brief Heap memory owned by a tree in bytes, not counting the root node itself. Shared nodes are
+ * only counted once however many nodes point at them
+ */
+struct MemoryUsage
+{
+    std::size_t nodes = 0;
+    std::size_t names = 0;
+    std::size_t values = 0;
+
+    /**
+     * @brief Child arrays and shared nodes
+     */
+    std::size_t children = 0;
+
+    /**
+     * @brief Capacity of strings and child arrays that is allocated but unused
+     */
+    std::size_t slack = 0;
+
+    inline std::size_t total() const { return names + values + children + slack; }
+};
+
+struct CompactOptions
+{
+    /**
+     * @brief Makes subtrees and long values that appear more than once point at the same shared
+     * node, so they are only stored once. They are written as anchors and aliases from then on
+     */
+    bool share_duplicates = false;
 };
 
+class Journal;
+
 /**
  * @class Node
  * @brief This library interprets yaml as a collection of nodes within nodes. A node contains the
@@ -154,6 +498,7 @@ class Node
 {
   public:
     using Iterator = NodeIterator<Node>;
+    using ConstIterator = NodeIterator<const Node>;
 
     static const std::size_t null_index;
 
@@ -163,113 +508,1330 @@ class Node
     inline static constexpr std::size_t max_line_size() { return 2048; }
 
     /**
-     * @brief Max size a nodes name can be within a line of a file
+     * @brief Max size a nodes name can be within a line of a file
+     */
+    inline static constexpr std::size_t max_name_size() { return 100; }
+
+    /**
+     * @brief Max size a nodes value as a string can be within a line of a file
+     */
+    inline static constexpr std::size_t max_value_size() { return 1948; }
+
+    /**
+     * @brief Amount of output buffered while writing before it is flushed into the file
+     */
+    inline static constexpr std::size_t write_buffer_size() { return 64 * 1024; }
+
+  public:
+    Node() = default;
+    Node(const std::string& field_name);
+    Node(const std::string& field_name, const std::string& value);
+    Node(const std::string& field_name, std::shared_ptr<const Node> shared);
+    Node(const Node& other);
+    Node(Node&& other) noexcept;
+    ~Node() = default;
+
+    Node& operator=(const Node& other);
+    Node& operator=(Node&& other) noexcept;
+    Node& operator<<(const Node& other);
+
+    template<typename _T>
+    Node& operator=(const _T& value)
+    {
+        _unshare();
+        m_value = Convert<_T>().value_to_str(value);
+        invalidate_hash();
+        if (detail::journal_count.load(std::memory_order_relaxed) > 0)
+            _record('v');
+        return *this;
+    }
+
+    inline Node& operator[](const std::string& field_name) { return get_child(field_name); }
+    inline const Node& operator[](const std::string& field_name) const
+    {
+        return get_child(field_name);
+    }
+    inline Node& operator[](std::size_t index) { return get_child(index); }
+    inline const Node& operator[](std::size_t index) const { return get_child(index); }
+
+    inline bool operator==(const Node& other) const { return compare(other); }
+    inline bool operator!=(const Node& other) const { return !(*this == other); }
+
+    inline yaml::Node& front() { return get_children().front(); }
+    inline yaml::Node& back() { return get_children().back(); }
+    inline const yaml::Node& front() const { return get_children().front(); }
+    inline const yaml::Node& back() const { return get_children().back(); }
+
+    /**
+     * @brief Iterating over a non const node gives a shared node its own copy of the children, same
+     * as get_children(). Iterate over std::as_const(node) to only read them
+     */
+    inline Iterator begin() { return Iterator(get_children().begin()); }
+    inline Iterator end() { return Iterator(get_children().end()); }
+    inline ConstIterator begin() const { return ConstIterator(get_children().begin()); }
+    inline ConstIterator end() const { return ConstIterator(get_children().end()); }
+
+    /**
+     * @brief Every node below this one, each node before its children. Iterating over a non const
+     * node gives each shared node visited its own copy, same as get_children(). Iterate over
+     * std::as_const(node).depth_first() to only read them
+     */
+    inline TraversalRange<Node, Traversal::DepthFirst> depth_first() { return *this; }
+    inline TraversalRange<const Node, Traversal::DepthFirst> depth_first() const { return *this; }
+
+    /**
+     * @brief Every node below this one, a level at a time
+     */
+    inline TraversalRange<Node, Traversal::BreadthFirst> breadth_first() { return *this; }
+    inline TraversalRange<const Node, Traversal::BreadthFirst> breadth_first() const
+    {
+        return *this;
+    }
+
+    inline const std::string& get_name() const { return m_name; }
+    inline const std::string& get_value() const { return _content().m_value; }
+    inline const std::vector<Node>& get_children() const { return _content().m_children; }
+    inline const Node* get_parent() const { return m_parent; }
+
+    /**
+     * @brief Gives direct access to the children, so the cached hash is invalidated in case they
+     * are modified through it, and a shared node gets its own copy of them. Children added through
+     * it, or moved when it grows, don't have their parent set, use push_back() instead
+     */
+    inline std::vector<Node>& get_children()
+    {
+        _unshare();
+        invalidate_hash();
+        return m_children;
+    }
+    inline Node* get_parent() { return m_parent; }
+
+    /**
+     * @brief The non const overloads give a shared node its own copy of the children, since the
+     * child returned may be modified. Use the const overloads, e.g. through std::as_const(node), to
+     * read a shared node without copying it
+     */
+    Node& get_child(const std::string& field_name);
+    Node& get_child(std::size_t index);
+    const Node& get_child(const std::string& field_name) const;
+    const Node& get_child(std::size_t index) const;
+
+    template<typename _T>
+    _T as() const
+    {
+#if defined(YAML_STATS)
+        std::uint64_t start = detail::now_ns();
+        _T value = Convert<_T>().value(get_value());
+        detail::record_conversion(start);
+        return value;
+#else
+        return Convert<_T>().value(get_value());
+#endif
+    }
+
+    std::string get_as_string() const;
+
+    inline void set_parent(Node* parent) { m_parent = parent; }
+
+    bool open(const std::string& filename);
+
+    /**
+     * @brief Same as open(filename) but within the given limits, reporting why it failed. The node
+     * is left empty on failure
+     */
+    ParseResult open(const std::string& filename, const ParseOptions& options);
+
+    inline bool empty() const { return get_children().size() == 0; }
+    void push_back(const Node& node);
+    void push_back(Node&& node);
+    void pop_back(std::size_t count = 1);
+
+    /**
+     * @brief Compares the name, value and children of both nodes, but not where they are placed
+     * within their trees. Uses the cached hashes to return early when the trees differ
+     */
+    bool compare(const Node& other) const;
+
+    /**
+     * @brief Hash of the nodes name, value and all of its children. Computed on first use and
+     * cached until the node or one of its children is modified. Safe to call from many threads on
+     * a tree that isn't being modified
+     */
+    std::uint64_t get_hash() const;
+
+    /**
+     * @brief Clears the cached hash of this node and all of its parents. Called by every function
+     * that modifies the node, only needed when modifying it by some other means
+     */
+    void invalidate_hash();
+
+    /**
+     * @brief Moves the value and children of the node into an immutable shared node, named after
+     * the anchor it is written with. Nodes made from the result (see yaml::alias()) all point at
+     * the same memory and are written as aliases of this one. Modifying any of them gives that
+     * node its own copy again
+     */
+    std::shared_ptr<const Node> share(const std::string& anchor);
+
+    /**
+     * @brief Shared node the value and children are read from, or nullptr when the node has its
+     * own
+     */
+    inline const std::shared_ptr<const Node>& get_shared() const { return m_shared; }
+
+    std::size_t exists(const std::string& field_name) const;
+
+    /**
+     * @brief Recursive breakdown of the memory used by the node's names, values and children
+     */
+    MemoryUsage memory_usage() const;
+
+    bool write_file(std::FILE* file) const;
+    bool write_file(const std::string& filename, const WriteOptions& options = {}) const;
+    bool write_if_file_exists(const std::string& filename) const;
+
+  private:
+    friend class Reader;
+    friend class Journal;
+    friend class WatchedDocument;
+    friend void compact(Node& node, const CompactOptions& options);
+    friend class StaticNode;
+
+    struct ParseState
+    {
+        std::FILE* file = nullptr;
+        ParseOptions options = {};
+        ParseStatus status = ParseStatus::Success;
+        std::size_t line = 0;
+        std::size_t nodes = 0;
+        std::size_t bytes = 0;
+        bool has_references = false;
+    };
+
+    struct WriteContext
+    {
+        std::string& str;
+        std::FILE* file = nullptr;
+        bool deduplicate = false;
+        std::unordered_map<std::uint64_t, std::size_t> counts = {};
+        // NOTE: keyed by content hash, each anchored node is kept to rule out collisions
+        std::unordered_multimap<std::uint64_t, std::pair<const Node*, std::string>> anchors = {};
+        std::unordered_set<std::string> labels = {};
+    };
+
+    inline const Node& _content() const { return m_shared != nullptr ? *m_shared : *this; }
+    inline void _unshare()
+    {
+        if (m_shared != nullptr)
+            _copy_shared();
+    }
+
+    void _copy_shared();
+    std::uint64_t _get_content_hash() const;
+    void _copy_hash(const Node& other);
+    static bool _equal_content(const Node& node, const Node& other);
+    void _relink_children();
+    Node& _add_child(Node&& node);
+    ParseResult _open_file(const std::string& filename, const ParseOptions& options = {});
+    ParseResult _open_file(const std::string& filename, ParseState& state);
+    void _record(char op, std::size_t count = 0) const;
+
+    static void _construct_string(std::string& str, const Node& node, std::size_t indent);
+    bool _write_children(WriteContext& context) const;
+    static bool _write_node(WriteContext& context, const Node& node, std::size_t indent);
+    static void _count_duplicates(
+        std::unordered_map<std::uint64_t, std::size_t>& counts, const Node& node
+    );
+    static void _share_duplicates(
+        Node& node, const std::unordered_map<std::uint64_t, std::size_t>& counts,
+        std::unordered_multimap<std::uint64_t, std::shared_ptr<const Node>>& shared
+    );
+    static void _compact(Node& node);
+    static void _add_memory_usage(
+        const Node& node, MemoryUsage& usage, std::unordered_set<const Node*>& visited
+    );
+    static void _read_node(ParseState& state, Node& root);
+    static void _resolve_references(
+        Node& node, std::unordered_map<std::string, std::shared_ptr<const Node>>& anchors
+    );
+    static bool _read_line(
+        ParseState& state, char* name, char* value, std::size_t& name_size,
+        std::size_t& value_size, std::size_t& indent_size
+    );
+
+  private:
+    std::string m_name = {};
+    std::string m_value = {};
+    std::vector<Node> m_children = {};
+    std::shared_ptr<const Node> m_shared = nullptr;
+    Node* m_parent = nullptr;
+
+    // NOTE: only set on the root of a tree with a yaml::Journal attached
+    Journal* m_journal = nullptr;
+
+    // NOTE: atomic as const functions fill them in, which can happen on many threads at once
+    mutable std::atomic<std::uint64_t> m_hash = 0;
+    mutable std::atomic<bool> m_hash_valid = false;
+};
+
+Node& get_root_node(Node& node);
+const Node& get_root_node(const Node& node);
+Node open(const std::string& filename);
+
+/**
+ * @brief Shrinks the capacity of every string and child array to what they hold and reallocates
+ * them in depth first order so each subtree is close together in memory. Meant for long lived
+ * trees that have been edited a lot, see Node::memory_usage()
+ *
+ * @note Every child array is reallocated, so references and pointers to any node below the one
+ * given are invalid afterwards, including iterators and yaml::LayeredView layers
+ */
+void compact(Node& node, const CompactOptions& options = {});
+
+namespace detail {
+
+    /**
+     * @brief String literal usable as a template parameter
+     */
+    template<std::size_t _Size>
+    struct FixedString
+    {
+        char data[_Size] = {};
+
+        constexpr FixedString(const char (&str)[_Size])
+        {
+            for (std::size_t i = 0; i < _Size; i++)
+                data[i] = str[i];
+        }
+
+        constexpr std::string_view view() const { return std::string_view(data, _Size - 1); }
+    };
+
+    struct StaticEntry
+    {
+        std::size_t name_offset = 0;
+        std::size_t name_size = 0;
+        std::size_t value_size = 0;
+        std::size_t parent = std::string::npos;
+        std::size_t first_child = std::string::npos;
+        std::size_t next_sibling = std::string::npos;
+        std::size_t child_count = 0;
+    };
+
+    struct StaticLine
+    {
+        std::size_t indent = 0;
+        std::size_t name_size = 0;
+        std::size_t value_size = 0;
+    };
+
+    /**
+     * @brief Same as Node::_read_line() on a single line without its newline. The name then the
+     * value are passed to write(index, c) one character at a time, one after the other
+     */
+    template<typename _Write>
+    constexpr StaticLine read_static_line(std::string_view line, _Write&& write)
+    {
+        StaticLine result = {};
+        bool finished_indent_count = false;
+        bool fill_value = false;
+        bool fill_anchor = false;
+        std::size_t j = 0;
+
+        for (char c : line)
+        {
+            if (c == '#')
+                break;
+            if (c == '\r')
+                continue;
+
+            if (c == ' ')
+            {
+                if (!finished_indent_count)
+                    result.indent++;
+                else if (fill_anchor)
+                {
+                    // keep the space between an anchor and the value it is given to
+                    write(result.name_size + j, ' ');
+                    j++;
+                    fill_anchor = false;
+                }
+                continue;
+            }
+
+            finished_indent_count = true;
+            if (c == ':' && !fill_value)
+            {
+                fill_value = true;
+                result.name_size = j;
+                j = 0;
+                continue;
+            }
+
+            if (fill_value && j == 0 && c == '&')
+                fill_anchor = true;
+            write((fill_value ? result.name_size : 0) + j, c);
+            j++;
+        }
+
+        assert(
+            (fill_value || j == 0) &&
+            "YAML ASSERT: yaml syntax error, must have a ':' after field name"
+        );
+        result.value_size = fill_value ? j : 0;
+        return result;
+    }
+
+    // NOTE: not std::string_view::find(), which some compilers can't evaluate at compile time on
+    // a template parameter
+    constexpr std::size_t find_line_end(std::string_view text, std::size_t begin)
+    {
+        while (begin < text.size() && text[begin] != '\n')
+            begin++;
+        return begin;
+    }
+
+    constexpr std::size_t count_static_nodes(std::string_view text)
+    {
+        std::size_t count = 1;
+        for (std::size_t begin = 0; begin < text.size();)
+        {
+            std::size_t end = detail::find_line_end(text, begin);
+            StaticLine line =
+                read_static_line(text.substr(begin, end - begin), [](std::size_t, char) {});
+            count += line.name_size > 0;
+            begin = end + 1;
+        }
+        return count;
+    }
+
+} // namespace detail
+
+/**
+ * @class StaticNode
+ * @brief Read only node of a yaml::StaticDocument, with the same lookups as yaml::Node that can
+ * also be used at compile time
+ */
+class StaticNode
+{
+  public:
+    constexpr StaticNode(const detail::StaticEntry* entries, const char* chars, std::size_t index)
+        : m_entries(entries), m_chars(chars), m_index(index)
+    {
+    }
+
+    constexpr std::string_view get_name() const
+    {
+        const detail::StaticEntry& entry = m_entries[m_index];
+        return std::string_view(m_chars + entry.name_offset, entry.name_size);
+    }
+
+    constexpr std::string_view get_value() const
+    {
+        const detail::StaticEntry& entry = m_entries[m_index];
+        return std::string_view(m_chars + entry.name_offset + entry.name_size, entry.value_size);
+    }
+
+    constexpr std::size_t size() const { return m_entries[m_index].child_count; }
+    constexpr bool empty() const { return size() == 0; }
+
+    /**
+     * @return Index of the child, or Node::null_index when there is none with that name
+     */
+    constexpr std::size_t exists(std::string_view field_name) const
+    {
+        std::size_t i = 0;
+        for (std::size_t child = m_entries[m_index].first_child; child != std::string::npos;
+             child = m_entries[child].next_sibling, i++)
+        {
+            if (StaticNode(m_entries, m_chars, child).get_name() == field_name)
+                return i;
+        }
+        return std::string::npos;
+    }
+
+    constexpr StaticNode get_child(std::string_view field_name) const
+    {
+        std::size_t index = exists(field_name);
+        assert(index != std::string::npos && "YAML ASSERT: failed to find child node");
+        return get_child(index);
+    }
+
+    constexpr StaticNode get_child(std::size_t index) const
+    {
+        assert(index < size() && "YAML ASSERT: child index out of range");
+        std::size_t child = m_entries[m_index].first_child;
+        for (; index > 0; index--)
+            child = m_entries[child].next_sibling;
+        return StaticNode(m_entries, m_chars, child);
+    }
+
+    constexpr StaticNode operator[](std::string_view field_name) const
+    {
+        return get_child(field_name);
+    }
+
+    constexpr StaticNode operator[](std::size_t index) const { return get_child(index); }
+
+    template<typename _T>
+    _T as() const
+    {
+        return Convert<_T>().value(std::string(get_value()));
+    }
+
+    /**
+     * @brief Copies the node and its children into a yaml::Node that can be modified, resolving
+     * anchors and aliases the same as Node::open()
+     */
+    Node to_node() const;
+
+  private:
+    static void _add_children(Node& node, const StaticNode& static_node, bool& has_references);
+
+  private:
+    const detail::StaticEntry* m_entries = nullptr;
+    const char* m_chars = nullptr;
+    std::size_t m_index = 0;
+};
+
+/**
+ * @class StaticDocument<_Nodes, _Chars>
+ * @brief Yaml parsed at compile time into constant tables of names, values and where each node's
+ * children are. Made with yaml::static_document rather than directly
+ */
+template<std::size_t _Nodes, std::size_t _Chars>
+class StaticDocument
+{
+  public:
+    consteval StaticDocument(std::string_view text)
+    {
+        // NOTE: the first entry is the root, every line after it follows the same rules as
+        // Node::_read_node()
+        std::array<std::size_t, _Nodes> last_child = {};
+        last_child.fill(std::string::npos);
+
+        // NOTE: the entries from the root down to the last one read, and the indent of each
+        // entry's children once the first one has been read
+        std::array<std::size_t, _Nodes> levels = {};
+        std::array<std::size_t, _Nodes> indents = {};
+        std::array<std::size_t, _Nodes> child_indents = {};
+        child_indents.fill(std::string::npos);
+        std::size_t depth = 1;
+
+        std::size_t count = 1;
+        std::size_t offset = 0;
+
+        for (std::size_t begin = 0; begin < text.size();)
+        {
+            std::size_t end = detail::find_line_end(text, begin);
+            std::string_view line = text.substr(begin, end - begin);
+            begin = end + 1;
+
+            detail::StaticLine result = detail::read_static_line(
+                line, [&](std::size_t index, char c) { m_chars[offset + index] = c; }
+            );
+            if (result.name_size == 0)
+                continue;
+
+            while (depth > 1 && indents[levels[depth - 1]] >= result.indent)
+                depth--;
+
+            std::size_t parent = levels[depth - 1];
+            if (child_indents[parent] == std::string::npos)
+                child_indents[parent] = result.indent;
+            assert(
+                child_indents[parent] == result.indent &&
+                "YAML ASSERT: yaml syntax error, field is indented differently to its siblings"
+            );
+
+            detail::StaticEntry& entry = m_entries[count];
+            entry.name_offset = offset;
+            entry.name_size = result.name_size;
+            entry.value_size = result.value_size;
+            entry.parent = parent;
+
+            if (last_child[parent] == std::string::npos)
+                m_entries[parent].first_child = count;
+            else
+                m_entries[last_child[parent]].next_sibling = count;
+            last_child[parent] = count;
+            m_entries[parent].child_count++;
+
+            offset += result.name_size + result.value_size;
+            indents[count] = result.indent;
+            levels[depth++] = count++;
+        }
+    }
+
+    constexpr StaticNode root() const { return StaticNode(m_entries.data(), m_chars.data(), 0); }
+
+    constexpr StaticNode get_child(std::string_view field_name) const
+    {
+        return root().get_child(field_name);
+    }
+
+    constexpr StaticNode operator[](std::string_view field_name) const
+    {
+        return root().get_child(field_name);
+    }
+
+    Node to_node() const { return root().to_node(); }
+
+  private:
+    std::array<detail::StaticEntry, _Nodes> m_entries = {};
+    std::array<char, _Chars> m_chars = {};
+};
+
+/**
+ * @brief Yaml string literal parsed at compile time, so it costs nothing to load at startup
+ *
+ * @code
+ * constexpr auto& defaults = yaml::static_document<"Window:\n  width: 1280\n">;
+ * static_assert(defaults["Window"]["width"].get_value() == "1280");
+ * @endcode
+ */
+template<detail::FixedString _Text>
+inline constexpr StaticDocument<detail::count_static_nodes(_Text.view()), sizeof(_Text.data)>
+    static_document = StaticDocument<
+        detail::count_static_nodes(_Text.view()), sizeof(_Text.data)>(_Text.view());
+
+enum class MergePolicy
+{
+    /**
+     * @brief Values in the overlay replace values in the base, fields with children in both are
+     * merged recursively
+     */
+    Deep,
+
+    /**
+     * @brief Fields in the overlay replace the whole field in the base, including its children
+     */
+    Replace,
+
+    /**
+     * @brief Only fields missing from the base are added, existing values are kept
+     */
+    AddMissing,
+};
+
+/**
+ * @brief Merges the children of overlay into base. Children are matched by name through a hash
+ * table once there are enough of them, so the cost grows with the size of the overlay rather than
+ * the size of the overlay times the size of the base
+ */
+void merge(Node& base, const Node& overlay, MergePolicy policy = MergePolicy::Deep);
+
+/**
+ * @class LayeredView
+ * @brief Read only view of trees stacked on top of each other, answering lookups the same as
+ * yaml::merge() with MergePolicy::Deep would without building the merged tree. Layers are
+ * referenced, not copied, so they must outlive the view and not be modified while it is in use.
+ * Lookups can be made from many threads at once
+ */
+class LayeredView
+{
+  public:
+    LayeredView() = default;
+
+    /**
+     * @param layers From the bottom (base) layer to the top one, which takes priority
+     */
+    LayeredView(std::vector<const Node*> layers);
+
+    /**
+     * @brief Adds a layer on top of the others. The view starts a new lookup cache, views made from
+     * it before keep using the old one
+     */
+    void push_layer(const Node& layer);
+
+    inline const std::vector<const Node*>& get_layers() const { return m_layers; }
+    inline bool empty() const { return m_layers.empty(); }
+
+    bool exists(const std::string& field_name) const;
+
+    /**
+     * @brief View of the field in each layer that has it, down to the first layer where it has a
+     * value rather than children as that hides the layers below it
+     */
+    LayeredView get_child(const std::string& field_name) const;
+    inline LayeredView operator[](const std::string& field_name) const
+    {
+        return get_child(field_name);
+    }
+
+    /**
+     * @brief Names of the children in any layer, in the order they would be in the merged tree
+     */
+    std::vector<std::string> get_child_names() const;
+
+    const std::string& get_value() const;
+
+    template<typename _T>
+    _T as() const
+    {
+        return Convert<_T>().value(get_value());
+    }
+
+    /**
+     * @brief Builds the merged tree
+     */
+    Node to_node() const;
+
+  private:
+    struct IndexCache
+    {
+        std::shared_mutex mutex = {};
+        std::unordered_map<const Node*, std::unordered_map<std::string_view, std::size_t>>
+            indexes = {};
+    };
+
+    std::size_t _find(const Node& node, const std::string& field_name) const;
+
+  private:
+    std::vector<const Node*> m_layers = {};
+
+    // NOTE: shared with every view made from this one, so wide children are only indexed once
+    std::shared_ptr<IndexCache> m_cache = std::make_shared<IndexCache>();
+};
+
+enum class ViolationType
+{
+    Missing,
+
+    /**
+     * @brief The value can't be converted into the type the field was declared with
+     */
+    WrongType,
+
+    /**
+     * @brief A sequence has fewer or more values than allowed
+     */
+    WrongLength,
+};
+
+struct Violation
+{
+    ViolationType type = ViolationType::Missing;
+
+    /**
+     * @brief Field names from the root down to the node, separated by '/'
+     */
+    std::string path = {};
+};
+
+namespace detail {
+
+    enum class ValueKind
+    {
+        Any,
+        Text,
+        String,
+        Character,
+        Bool,
+        Integer,
+        Unsigned,
+        Float,
+        Sequence,
+    };
+
+    struct ValueRule
+    {
+        ValueKind kind = ValueKind::Any;
+
+        /**
+         * @brief Kind of each value in a sequence
+         */
+        ValueKind element = ValueKind::Any;
+
+        // range of integer values, or of each value in a sequence of integers
+        std::int64_t min = 0;
+        std::uint64_t max = 0;
+
+        std::size_t min_length = 0;
+        std::size_t max_length = std::numeric_limits<std::size_t>::max();
+    };
+
+    template<typename _T>
+    struct IsVector : std::false_type
+    {
+    };
+
+    template<typename _T>
+    struct IsVector<std::vector<_T>> : std::true_type
+    {
+    };
+
+    /**
+     * @brief What a value written by Convert<_T> looks like. Types other than the default
+     * supported ones are only required to have a value
+     */
+    template<typename _T>
+    constexpr ValueRule value_rule()
+    {
+        // NOTE: implementations outside of the library don't have to define supported()
+        if constexpr (requires { Convert<_T>().supported(); })
+        {
+            static_assert(
+                Convert<_T>().supported(),
+                "YAML ASSERT: type must have a yaml::Convert<_T> implementation"
+            );
+        }
+
+        ValueRule rule = {};
+        if constexpr (IsVector<_T>::value)
+        {
+            rule = value_rule<typename _T::value_type>();
+            rule.element = rule.kind;
+            rule.kind = ValueKind::Sequence;
+        }
+        else if constexpr (std::is_same_v<_T, bool>)
+            rule.kind = ValueKind::Bool;
+        else if constexpr (std::is_same_v<_T, std::int8_t> || std::is_same_v<_T, std::uint8_t>)
+            rule.kind = ValueKind::Character;
+        else if constexpr (std::is_integral_v<_T> && std::is_signed_v<_T>)
+        {
+            rule.kind = ValueKind::Integer;
+            rule.min = std::numeric_limits<_T>::min();
+            rule.max = std::numeric_limits<_T>::max();
+        }
+        else if constexpr (std::is_integral_v<_T>)
+        {
+            rule.kind = ValueKind::Unsigned;
+            rule.max = std::numeric_limits<_T>::max();
+        }
+        else if constexpr (std::is_floating_point_v<_T>)
+            rule.kind = ValueKind::Float;
+        else if constexpr (std::is_same_v<_T, std::string>)
+            rule.kind = ValueKind::String;
+        else
+            rule.kind = ValueKind::Text;
+        return rule;
+    }
+
+} // namespace detail
+
+/**
+ * @class Schema
+ * @brief Fields a document must or may have and the types of their values. Fields are given as
+ * paths of field names separated by '/', where "*" matches a field of any name, including ones
+ * that have rules of their own, and a field must pass every rule matching it. Rules are compiled
+ * into a table of hash lookups by name the first time the schema is used, so a document is checked
+ * in a single pass however many rules there are. Rules must not be added while another thread is
+ * validating with the schema
+ */
+class Schema
+{
+  public:
+    Schema() = default;
+
+    /**
+     * @brief Copies the rules only, the copy compiles them again when it is first used
+     */
+    Schema(const Schema& other);
+    Schema& operator=(const Schema& other);
+
+    /**
+     * @brief The field and every field above it must exist, and its value must be convertible into
+     * _T unless _T is void
+     */
+    template<typename _T = void>
+    Schema& required(const std::string& path)
+    {
+        return _add(path, _get_rule<_T>(), true);
+    }
+
+    /**
+     * @brief When the field exists, its value must be convertible into _T
+     */
+    template<typename _T>
+    Schema& optional(const std::string& path)
+    {
+        return _add(path, _get_rule<_T>(), false);
+    }
+
+    /**
+     * @brief The field must be a sequence of values convertible into _T, with a length within the
+     * given range
+     */
+    template<typename _T>
+    Schema& sequence(
+        const std::string& path, std::size_t min_length,
+        std::size_t max_length = std::numeric_limits<std::size_t>::max(), bool required = true
+    )
+    {
+        detail::ValueRule rule = detail::value_rule<std::vector<_T>>();
+        rule.min_length = min_length;
+        rule.max_length = max_length;
+        return _add(path, rule, required);
+    }
+
+    /**
+     * @return Every violation found within the tree, empty when it is valid
+     */
+    std::vector<Violation> validate(const Node& node) const;
+
+    /**
+     * @brief Validates a file as it is read, without building a tree. Aliases aren't followed, so
+     * their values and children are assumed valid
+     *
+     * @param violations Filled with every violation found within the file
+     */
+    ParseResult validate_file(
+        const std::string& filename, std::vector<Violation>& violations,
+        const ParseOptions& options = {}
+    ) const;
+
+  private:
+    struct Rule
+    {
+        std::vector<std::string> path = {};
+        detail::ValueRule value = {};
+        bool required = false;
+    };
+
+    struct Entry
+    {
+        std::string name = {};
+
+        /**
+         * @brief Indices of every rule matching the field, into m_rules
+         */
+        std::vector<std::size_t> rules = {};
+        std::unordered_map<std::string, std::size_t> children = {};
+        std::size_t wildcard = std::string::npos;
+
+        /**
+         * @brief Index among the parent's required children, or npos when not required
+         */
+        std::size_t required_slot = std::string::npos;
+        std::vector<std::size_t> required_children = {};
+    };
+
+    template<typename _T>
+    static constexpr detail::ValueRule _get_rule()
+    {
+        if constexpr (std::is_void_v<_T>)
+            return detail::ValueRule();
+        else
+            return detail::value_rule<_T>();
+    }
+
+    Schema& _add(const std::string& path, const detail::ValueRule& rule, bool required);
+    void _compile() const;
+    void _apply(std::size_t rule) const;
+    std::size_t _add_entry(std::size_t parent, const std::string& name) const;
+    std::size_t _match(const Entry& entry, const std::string& field_name) const;
+    bool _check_rules(const Entry& entry, std::string_view value, ViolationType& type) const;
+    void _validate_node(
+        const Node& node, std::size_t entry, std::string& path,
+        std::vector<Violation>& violations
+    ) const;
+    void _add_missing(
+        std::size_t entry, const std::vector<bool>& seen, const std::string& path,
+        std::vector<Violation>& violations
+    ) const;
+
+  private:
+    std::vector<Rule> m_rules = {};
+
+    // NOTE: built from m_rules by _compile(), the first entry is the root
+    mutable std::vector<Entry> m_entries = {};
+    mutable std::atomic<bool> m_compiled = false;
+    mutable std::mutex m_compile_mutex = {};
+};
+
+enum class ChangeType
+{
+    Added,
+    Removed,
+    Modified,
+};
+
+struct Change
+{
+    ChangeType type = ChangeType::Modified;
+
+    /**
+     * @brief Field names from the root down to the changed node, separated by '/'
+     */
+    std::string path = {};
+};
+
+/**
+ * @brief Finds the differences between two trees, matching children by their field name. Subtrees
+ * with different hashes are known to have changed without comparing them, but subtrees with the
+ * same hash are still compared in full to rule out a collision. So the cost is O(n) in the size of
+ * the trees rather than in the size of the change, only subtrees shared between both trees are
+ * skipped outright
+ *
+ * @return Nodes added to, removed from or modified in after compared to before
+ */
+std::vector<Change> diff(const Node& before, const Node& after);
+
+struct OpenOptions
+{
+    /**
+     * @brief Number of worker threads used to parse the files, 0 uses one per hardware thread
+     */
+    std::size_t thread_count = 0;
+
+    /**
+     * @brief Limits applied to each file on its own
+     */
+    ParseOptions parse = {};
+};
+
+struct OpenResult
+{
+    Node node = {};
+    bool success = false;
+
+    /**
+     * @brief errno from opening the file when parse.status is ParseStatus::FileNotFound, otherwise
+     * 0. Files that opened but failed to parse are described by parse
+     */
+    int error = 0;
+
+    ParseResult parse = {};
+};
+
+/**
+ * @brief Opens and parses many files at once across a pool of worker threads. Each worker grabs
+ * the next unparsed file as soon as it finishes its last one, so a few large files don't hold up
+ * the rest
+ *
+ * @return One result per filename, in the same order as filenames
+ */
+std::vector<OpenResult> open_many(
+    std::span<const std::string> filenames, const OpenOptions& options = {}
+);
+
+/**
+ * @brief Calls fn on every node below node, splitting the tree into independent subtrees depth
+ * levels down that are visited across a pool of worker threads. Nodes above that level are
+ * visited on the calling thread first. Each worker grabs the next subtree as soon as it finishes
+ * its last one, so a few large subtrees don't hold up the rest
+ *
+ * fn can modify the node it is given and its children, but not the node's parent or siblings.
+ * Changes recorded by a yaml::Journal are appended one at a time under its lock. When fn throws,
+ * no more subtrees are started, the workers are joined and the first exception is rethrown on the
+ * calling thread
+ *
+ * @param depth Level to split the tree at, 1 gives each child of node its own subtree
+ * @param thread_count Number of worker threads, 0 uses one per hardware thread
+ */
+void parallel_for_each(
+    Node& node, std::size_t depth, const std::function<void(Node&)>& fn,
+    std::size_t thread_count = 0
+);
+void parallel_for_each(
+    const Node& node, std::size_t depth, const std::function<void(const Node&)>& fn,
+    std::size_t thread_count = 0
+);
+
+namespace detail {
+
+    /**
+     * @brief Callables that take a const node, so only read the tree. Generic lambdas are left out
+     * as checking them would instantiate their body with a const node
+     */
+    template<typename _Fn>
+    concept NodeReader = (requires { &_Fn::operator(); } || std::is_pointer_v<_Fn>) &&
+                         std::is_invocable_v<const _Fn&, const Node&>;
+
+} // namespace detail
+
+/**
+ * @brief Visits a non const node with a callable that only reads it through the const overload,
+ * so shared subtrees aren't given their own copy and cached hashes are kept
+ */
+template<detail::NodeReader _Fn>
+void parallel_for_each(Node& node, std::size_t depth, const _Fn& fn, std::size_t thread_count = 0)
+{
+    parallel_for_each(
+        std::as_const(node), depth, std::function<void(const Node&)>(fn), thread_count
+    );
+}
+
+struct JournalOptions
+{
+    /**
+     * @brief Size the log can grow to before save() compacts it into the base file
+     */
+    std::size_t max_log_size = 64 * 1024 * 1024;
+};
+
+/**
+ * @class Journal
+ * @brief Records changes made to a tree into a log file next to its base file (<filename>.journal)
+ * so saving only costs as much as what has changed. Nodes changed through operator=, operator<<,
+ * push_back and pop_back are recorded, modifying the children vector directly is not.
+ * Journal::open() opens the base file with the log replayed on top, yaml::open() only reads the
+ * base file. The root node must stay at the same address while the journal is attached
+ */
+class Journal
+{
+  public:
+    /**
+     * @brief Opens filename into root, replays its log and attaches to root
+     */
+    Journal(Node& root, const std::string& filename, const JournalOptions& options = {});
+    Journal(const Journal& other) = delete;
+    ~Journal();
+
+    Journal& operator=(const Journal& other) = delete;
+
+    inline bool is_open() const { return m_log != nullptr; }
+    inline std::size_t get_log_size() const { return m_log_size; }
+
+    /**
+     * @brief Flushes the recorded changes to disk, compacting them into the base file once the log
+     * has grown past JournalOptions::max_log_size and the tree can be compacted
+     */
+    bool save();
+
+    /**
+     * @brief Rewrites the base file with the current tree and empties the log
+     *
+     * @return false without touching either file when a name or value contains a line break, which
+     * the base file can't hold. The changes stay in the log instead
+     */
+    bool compact();
+
+    /**
+     * @brief Opens filename into root and replays its log on top, without attaching to root. The
+     * limits cover the log as well, each record in it counting as a line. When the log goes over
+     * one the tree is discarded and the line is the record the log stopped at
+     */
+    static ParseResult open(
+        Node& root, const std::string& filename, const ParseOptions& options = {}
+    );
+
+    /**
+     * @brief Applies the log of filename on top of root, which must contain the base file. Called
+     * by Journal::open(), so only needed when the base file was read some other way
+     *
+     * @return false when there is no log or it was written for a different base file
+     */
+    static bool replay(Node& root, const std::string& filename);
+
+  private:
+    friend class Node;
+
+    void _append(const std::string& record);
+    bool _start_log();
+    static bool _apply_log(Node& root, std::FILE* log, Node::ParseState& state);
+    static bool _apply_record(Node& root, const std::string& record, Node::ParseState& state);
+
+  private:
+    Node& m_root;
+    std::string m_filename = {};
+    JournalOptions m_options = {};
+    std::FILE* m_log = nullptr;
+    std::atomic<std::size_t> m_log_size = 0;
+
+    // NOTE: changes can be recorded from many threads at once, see yaml::parallel_for_each()
+    std::mutex m_mutex = {};
+};
+
+/**
+ * @class WatchedDocument
+ * @brief Keeps a tree in sync with its file as the file is edited. When the file changes, only the
+ * top level sections whose text has changed are parsed again and patched into the tree, so nodes
+ * within unchanged sections are left where they are. Uses inotify on Linux and otherwise compares
+ * the files write time
+ *
+ * Added sections are inserted where they are in the file. The top level nodes are kept in one
+ * array, so adding or removing a section moves the top level nodes after it and references to them
+ * are invalidated. Nodes below the top level of an unchanged section never move
+ */
+class WatchedDocument
+{
+  public:
+    using Callback = std::function<void(const Change& change)>;
+
+    WatchedDocument(const std::string& filename);
+    WatchedDocument(const WatchedDocument& other) = delete;
+    ~WatchedDocument();
+
+    WatchedDocument& operator=(const WatchedDocument& other) = delete;
+
+    inline Node& get_root() { return m_root; }
+    inline const Node& get_root() const { return m_root; }
+    inline const std::string& get_filename() const { return m_filename; }
+
+    /**
+     * @brief File descriptor that becomes readable when the file may have changed, so it can be
+     * added to an existing event loop. -1 when inotify isn't available
+     */
+    inline int get_fd() const { return m_fd; }
+
+    /**
+     * @brief Called with every path that changed whenever poll() reloads the file
+     */
+    inline void subscribe(Callback callback) { m_callbacks.push_back(std::move(callback)); }
+
+    /**
+     * @brief Checks whether the file has changed without blocking, and if so reloads the sections
+     * that changed
+     *
+     * @return true if the tree was modified
+     */
+    bool poll();
+
+  private:
+    struct Section
+    {
+        std::string name = {};
+        std::uint64_t hash = 0;
+    };
+
+    bool _reload(bool notify);
+    bool _has_changed();
+
+  private:
+    std::string m_filename = {};
+    Node m_root = {};
+    std::vector<Section> m_sections = {};
+    std::vector<Callback> m_callbacks = {};
+    std::unordered_map<std::string, std::shared_ptr<const Node>> m_anchors = {};
+    int m_fd = -1;
+    int m_watch = -1;
+    std::int64_t m_write_time = 0;
+};
+
+/**
+ * @class SharedDocument
+ * @brief Shares a tree between threads without locking readers. Readers take a snapshot of the
+ * current version, which stays valid and unchanged for as long as they hold it. Writers build a
+ * new version off to the side and publish it with a single atomic swap. Old versions are freed
+ * once no reader can still be looking at them, tracked with per reader epochs
+ */
+class SharedDocument
+{
+  public:
+    /**
+     * @brief Number of snapshots that can be held at the same time across all threads without
+     * touching a reference count. Snapshots past that share a reference counted pointer instead,
+     * which is slower but never fails
      */
-    inline static constexpr std::size_t max_name_size() { return 100; }
+    inline static constexpr std::size_t max_readers() { return 64; }
 
-    /**
-     * @brief Max size a nodes value as a string can be within a line of a file
-     */
-    inline static constexpr std::size_t max_value_size() { return 1948; }
+    class Snapshot
+    {
+      public:
+        Snapshot(const Snapshot& other) = delete;
+        Snapshot(Snapshot&& other) noexcept
+            : m_root(other.m_root), m_slot(other.m_slot), m_owner(std::move(other.m_owner))
+        {
+            other.m_slot = nullptr;
+        }
+        ~Snapshot();
 
-  public:
-    Node() = default;
-    Node(const std::string& field_name);
-    Node(const std::string& field_name, const std::string& value);
-    Node(const Node& other);
-    Node(Node&& other);
-    ~Node() = default;
+        Snapshot& operator=(const Snapshot& other) = delete;
 
-    Node& operator=(const Node& other);
-    Node& operator=(Node&& other);
-    Node& operator<<(const Node& other);
+        inline const Node& operator*() const { return *m_root; }
+        inline const Node* operator->() const { return m_root; }
+        inline const Node& get() const { return *m_root; }
 
-    template<typename _T>
-    Node& operator=(const _T& value)
-    {
-        m_value = Convert<_T>().value_to_str(value);
-        return *this;
-    }
+      private:
+        friend class SharedDocument;
 
-    inline Node& operator[](const std::string& field_name) { return get_child(field_name); }
-    inline Node& operator[](const std::string& field_name) const { return get_child(field_name); }
-    inline Node& operator[](std::size_t index) { return get_child(index); }
-    inline Node& operator[](std::size_t index) const { return get_child(index); }
+        Snapshot(
+            const Node* root, std::atomic<std::uint64_t>* slot,
+            std::shared_ptr<const Node> owner = nullptr
+        )
+            : m_root(root), m_slot(slot), m_owner(std::move(owner))
+        {
+        }
 
-    inline bool operator==(const Node& other) { return compare(other); }
-    inline bool operator!=(const Node& other) { return !(*this == other); }
+      private:
+        const Node* m_root = nullptr;
+        std::atomic<std::uint64_t>* m_slot = nullptr;
 
-    inline yaml::Node& front() { return m_children.front(); }
-    inline yaml::Node& back() { return m_children.back(); }
-    inline const yaml::Node& front() const { return m_children.front(); }
-    inline const yaml::Node& back() const { return m_children.back(); }
+        // NOTE: only set when every reader slot was taken
+        std::shared_ptr<const Node> m_owner = nullptr;
+    };
 
-    inline Iterator begin() { return Iterator(m_children.begin()); }
-    inline Iterator end() { return Iterator(m_children.end()); }
+  public:
+    SharedDocument(Node root = {});
+    SharedDocument(const SharedDocument& other) = delete;
 
-    inline const std::string& get_name() const { return m_name; }
-    inline const std::string& get_value() const { return m_value; }
-    inline const std::vector<Node>& get_children() const { return m_children; }
-    inline const Node* get_parent() const { return m_parent; }
+    /**
+     * @brief All snapshots must have been released before the document is destroyed
+     */
+    ~SharedDocument() = default;
 
-    inline std::vector<Node>& get_children() { return m_children; }
-    inline Node* get_parent() { return m_parent; }
+    SharedDocument& operator=(const SharedDocument& other) = delete;
 
-    Node& get_child(const std::string& field_name);
-    Node& get_child(std::size_t index);
-    inline Node& get_child(const std::string& field_name) const { return get_child(field_name); }
-    inline Node& get_child(std::size_t index) const { return get_child(index); }
+    /**
+     * @brief Takes a snapshot of the current version. Never waits on writers, and once all
+     * max_readers() slots are taken it falls back to reference counting rather than waiting for a
+     * slot to free up
+     */
+    Snapshot read() const;
 
-    template<typename _T>
-    _T as()
+    /**
+     * @brief Replaces the current version. Readers holding a snapshot keep seeing the old one
+     */
+    void publish(Node root);
+
+    /**
+     * @brief Copies the current version, lets fn modify the copy and publishes it. Writers are
+     * serialized, readers are never blocked
+     */
+    template<typename _Fn>
+    void update(_Fn&& fn)
     {
-        return Convert<_T>().value(m_value);
+        std::lock_guard<std::mutex> lock = std::lock_guard<std::mutex>(m_write_mutex);
+        Node root = *m_current.load();
+        fn(root);
+        _publish(std::move(root));
     }
 
-    std::string get_as_string() const;
+    /**
+     * @brief Frees the old versions that no snapshot can see anymore, done by every publish
+     *
+     * @return Number of versions still waiting on readers
+     */
+    std::size_t reclaim();
 
-    inline void set_parent(Node* parent) { m_parent = parent; }
+  private:
+    struct alignas(64) ReaderSlot
+    {
+        // epoch of the version the reader started on, 0 when the slot isn't being used
+        std::atomic<std::uint64_t> epoch = 0;
+    };
 
-    bool open(const std::string& filename);
-    inline bool empty() const { return m_children.size() == 0; }
-    inline void push_back(const Node& node) { m_children.push_back(node); }
-    inline void push_back(Node&& node) { m_children.push_back(std::move(node)); }
-    inline void pop_back(std::size_t count = 1) { m_children.resize(m_children.size() - count); }
-    bool compare(const Node& other) const;
-    std::size_t exists(const std::string& field_name) const;
+    struct Retired
+    {
+        std::shared_ptr<const Node> root = nullptr;
+        std::uint64_t epoch = 0;
+    };
 
-    bool write_file(std::FILE* file) const;
-    bool write_file(const std::string& filename) const;
-    bool write_if_file_exists(const std::string& filename) const;
+    void _publish(Node&& root);
+    std::size_t _reclaim();
 
   private:
-    static void _construct_string(std::string& str, const Node& node, std::size_t indent);
-    static bool _write_node(std::FILE* file, const Node& node, std::size_t indent);
-    static void _read_node(std::FILE* file, Node* last, std::size_t last_indent_size);
-    static bool _read_line(
-        std::FILE* file, char* name, char* value, std::size_t& name_size, std::size_t& value_size,
-        std::size_t& indent_size
-    );
+    std::atomic<const Node*> m_current = nullptr;
 
-  private:
-    std::string m_name = {};
-    std::string m_value = {};
-    std::vector<Node> m_children = {};
-    Node* m_parent = nullptr;
-};
+    // NOTE: owns the current version, given out to readers that didn't get a slot
+    std::atomic<std::shared_ptr<const Node>> m_owner = {};
 
-Node& get_root_node(Node& node);
-const Node& get_root_node(const Node& node);
-Node open(const std::string& filename);
+    std::atomic<std::uint64_t> m_epoch = 1;
+    mutable std::vector<ReaderSlot> m_readers = std::vector<ReaderSlot>(max_readers());
+    std::mutex m_write_mutex = {};
+    std::vector<Retired> m_retired = {};
+};
 
 inline bool write(const Node& node, std::FILE* file)
 {
     return get_root_node(node).write_file(file);
 }
 
-inline bool write(const Node& node, const std::string& filename)
+inline bool write(const Node& node, const std::string& filename, const WriteOptions& options = {})
 {
-    return get_root_node(node).write_file(filename);
+    return get_root_node(node).write_file(filename, options);
 }
 
 inline bool write_if_exists(const Node& node, const std::string& filename)
@@ -279,6 +1841,91 @@ inline bool write_if_exists(const Node& node, const std::string& filename)
 
 inline std::string get_root_as_string(Node& node) { return get_root_node(node).get_as_string(); }
 
+/**
+ * @class AsyncWriter
+ * @brief Writes trees into files on a background thread. Writes to a file that is still waiting
+ * to be written are merged, so only the newest tree gets written and every future given out for
+ * that file completes with its result
+ */
+class AsyncWriter
+{
+  public:
+    AsyncWriter();
+    AsyncWriter(const AsyncWriter& other) = delete;
+
+    /**
+     * @brief Finishes every queued write before returning
+     */
+    ~AsyncWriter();
+
+    AsyncWriter& operator=(const AsyncWriter& other) = delete;
+
+    /**
+     * @brief Queues the tree to be written into the file. Move the tree in to avoid copying it
+     *
+     * @return Completes with the result of the write, the same as yaml::write()
+     */
+    std::future<bool> write(
+        Node root, const std::string& filename, const WriteOptions& options = {}
+    );
+
+    /**
+     * @brief Queues a tree that is already shared, without copying it. The tree must not be
+     * modified until the write completes
+     */
+    std::future<bool> write(
+        std::shared_ptr<const Node> root, const std::string& filename,
+        const WriteOptions& options = {}
+    );
+
+    /**
+     * @brief Blocks until every queued write has finished
+     */
+    void wait();
+
+  private:
+    struct Job
+    {
+        std::shared_ptr<const Node> root = nullptr;
+        std::string filename = {};
+        WriteOptions options = {};
+        std::vector<std::promise<bool>> promises = {};
+    };
+
+    void _run();
+
+  private:
+    std::mutex m_mutex = {};
+    std::condition_variable m_condition = {};
+    std::vector<Job> m_jobs = {};
+    bool m_busy = false;
+    bool m_stop = false;
+    std::thread m_thread = {};
+};
+
+/**
+ * @brief Snapshots the tree the node is within and writes it on a shared background thread. The
+ * caller still pays for copying the whole tree, use one of the overloads below to avoid that
+ */
+std::future<bool> write_async(
+    const Node& node, const std::string& filename, const WriteOptions& options = {}
+);
+
+/**
+ * @brief Moves the root node into the background write, so the caller doesn't copy anything
+ */
+std::future<bool> write_async(
+    Node&& root, const std::string& filename, const WriteOptions& options = {}
+);
+
+/**
+ * @brief Writes a shared root node on the background thread without copying it, e.g. a version
+ * kept alive elsewhere. The tree must not be modified until the write completes
+ */
+std::future<bool> write_async(
+    std::shared_ptr<const Node> root, const std::string& filename, const WriteOptions& options = {}
+);
+
 template<typename _T>
 struct Convert<std::vector<_T>>
 {
@@ -521,6 +2168,18 @@ Node node(const std::string& field_name, const _T& value)
     return node;
 }
 
+/**
+ * @brief Creates a node sharing the value and children of a node returned by Node::share()
+ */
+inline Node alias(const std::string& field_name, std::shared_ptr<const Node> shared)
+{
+    assert(
+        field_name.size() < Node::max_name_size() &&
+        "YAML ASSERT: node name cannot exceed the max name size"
+    );
+    return Node(field_name, std::move(shared));
+}
+
 inline Node node(const std::string& field_name)
 {
     assert(
@@ -530,6 +2189,348 @@ inline Node node(const std::string& field_name)
     return Node(field_name);
 }
 
+/**
+ * @class Reader
+ * @brief Reads a yaml file one field at a time without building a yaml::Node tree. Used by
+ * yaml::load() to deserialize structs straight from the file
+ */
+class Reader
+{
+  public:
+    Reader(std::FILE* file, const ParseOptions& options = {})
+        : m_state(Node::ParseState{file, options})
+    {
+    }
+
+    /**
+     * @brief Reads the next line containing a field, skipping empty lines and comments
+     *
+     * @return false once the end of the file has been reached or the file is malformed, see
+     * get_status()
+     */
+    bool next();
+
+    /**
+     * @brief Puts the current line back so the following call to next() returns it again
+     */
+    inline void unread() { m_pending = true; }
+
+    inline std::string_view get_name() const { return std::string_view(m_name, m_name_size); }
+    inline std::string get_value() const { return std::string(m_value, m_value_size); }
+    inline std::size_t get_value_size() const { return m_value_size; }
+    inline std::size_t get_indent() const { return m_indent_size; }
+    inline ParseStatus get_status() const { return m_state.status; }
+    inline std::size_t get_line() const { return m_state.line; }
+
+  private:
+    Node::ParseState m_state = {};
+    char m_name[Node::max_name_size()];
+    char m_value[Node::max_value_size()];
+    std::size_t m_name_size = 0;
+    std::size_t m_value_size = 0;
+    std::size_t m_indent_size = 0;
+    bool m_pending = false;
+};
+
+/**
+ * @class Fields<_T>
+ * @brief Compile-time field table of a struct, used to read and write it directly from/to a file
+ * without going through yaml::Node. Don't specialize by hand, use the YAML_FIELDS macro instead
+ *
+ * @tparam _T Struct type
+ */
+template<typename _T>
+struct Fields
+{
+    constexpr bool supported() const { return false; }
+};
+
+namespace detail {
+
+    constexpr std::uint64_t hash_str(std::string_view str, std::uint64_t seed = 0)
+    {
+        // FNV-1a
+        std::uint64_t hash = 14695981039346656037ull ^ seed;
+        for (char c : str)
+        {
+            hash ^= static_cast<std::uint8_t>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /**
+     * @class KeyTable<_Count>
+     * @brief Perfect hash table of field names built at compile time. Every name maps to its own
+     * slot, so a lookup is a single hash and string compare
+     */
+    template<std::size_t _Count>
+    struct KeyTable
+    {
+        static constexpr std::size_t slot_count = std::bit_ceil(_Count) * 4;
+        static constexpr std::uint64_t max_seed = 1 << 16;
+
+        std::array<std::string_view, _Count> keys = {};
+        std::array<std::size_t, slot_count> slots = {};
+        std::uint64_t seed = 0;
+
+        constexpr KeyTable(const std::array<std::string_view, _Count>& names) : keys(names)
+        {
+            // NOTE: a throw isn't a constant expression, so duplicate names fail to compile even
+            // with asserts disabled
+            for (std::size_t i = 0; i < _Count; i++)
+            {
+                for (std::size_t j = i + 1; j < _Count; j++)
+                {
+                    if (keys[i] == keys[j])
+                        throw std::logic_error("YAML ASSERT: field names must be unique");
+                }
+            }
+
+            for (; seed < max_seed; seed++)
+            {
+                if (_try_seed())
+                    return;
+            }
+            throw std::logic_error("YAML ASSERT: failed to find a seed for the field names");
+        }
+
+        /**
+         * @return Index of the key, or Node::null_index when it isn't in the table
+         */
+        constexpr std::size_t find(std::string_view key) const
+        {
+            std::size_t index = slots[hash_str(key, seed) & (slot_count - 1)];
+            if (index < _Count && keys[index] == key)
+                return index;
+            return std::string::npos;
+        }
+
+      private:
+        constexpr bool _try_seed()
+        {
+            slots.fill(_Count);
+            for (std::size_t i = 0; i < _Count; i++)
+            {
+                std::size_t& slot = slots[hash_str(keys[i], seed) & (slot_count - 1)];
+                if (slot != _Count)
+                    return false;
+                slot = i;
+            }
+            return true;
+        }
+    };
+
+    inline void put(std::FILE* sink, std::string_view str)
+    {
+        std::fwrite(str.data(), 1, str.size(), sink);
+    }
+
+    inline void put(std::string& sink, std::string_view str) { sink.append(str); }
+
+    template<typename _Sink>
+    void put_indent(_Sink& sink, std::size_t indent)
+    {
+        static constexpr std::string_view spaces = "                                ";
+        for (; indent > spaces.size(); indent -= spaces.size())
+            put(sink, spaces);
+        put(sink, spaces.substr(0, indent));
+    }
+
+    template<typename _T>
+    void read_fields(Reader& reader, _T& obj, std::size_t indent);
+
+    template<typename _T>
+    void read_value(Reader& reader, _T& value, std::size_t indent)
+    {
+        if constexpr (Fields<_T>().supported())
+            read_fields(reader, value, indent + 2);
+        else if (reader.get_value_size() > 0)
+            value = Convert<_T>().value(reader.get_value());
+    }
+
+    template<typename _T, std::size_t... _I>
+    void read_member(
+        Reader& reader, _T& obj, std::size_t index, std::size_t indent, std::index_sequence<_I...>
+    )
+    {
+        constexpr auto& members = Fields<_T>::members;
+        ((index == _I && (read_value(reader, obj.*std::get<_I>(members), indent), true)) || ...);
+    }
+
+    template<typename _T>
+    void read_fields(Reader& reader, _T& obj, std::size_t indent)
+    {
+        constexpr std::size_t count = std::tuple_size_v<decltype(Fields<_T>::members)>;
+
+        while (reader.next())
+        {
+            if (reader.get_indent() < indent)
+            {
+                reader.unread();
+                return;
+            }
+
+            // children of a field the struct doesn't know about
+            if (reader.get_indent() > indent)
+                continue;
+
+            std::size_t index = Fields<_T>::keys.find(reader.get_name());
+            read_member(reader, obj, index, indent, std::make_index_sequence<count>());
+        }
+    }
+
+    template<typename _Sink, typename _T>
+    void write_fields(_Sink& sink, const _T& obj, std::size_t indent);
+
+    template<typename _Sink, typename _T>
+    void write_value(_Sink& sink, std::string_view name, const _T& value, std::size_t indent)
+    {
+        put_indent(sink, indent);
+        put(sink, name);
+
+        if constexpr (Fields<_T>().supported())
+        {
+            put(sink, ":\n");
+            write_fields(sink, value, indent + 2);
+        }
+        else
+        {
+            put(sink, ": ");
+            put(sink, Convert<_T>().value_to_str(value));
+            put(sink, "\n");
+        }
+    }
+
+    template<typename _Sink, typename _T, std::size_t... _I>
+    void write_members(_Sink& sink, const _T& obj, std::size_t indent, std::index_sequence<_I...>)
+    {
+        constexpr auto& members = Fields<_T>::members;
+        constexpr auto& keys = Fields<_T>::keys.keys;
+        (write_value(sink, keys[_I], obj.*std::get<_I>(members), indent), ...);
+    }
+
+    template<typename _Sink, typename _T>
+    void write_fields(_Sink& sink, const _T& obj, std::size_t indent)
+    {
+        constexpr std::size_t count = std::tuple_size_v<decltype(Fields<_T>::members)>;
+        write_members(sink, obj, indent, std::make_index_sequence<count>());
+    }
+
+} // namespace detail
+
+/**
+ * @brief Deserializes a struct declared with YAML_FIELDS straight from the file, without building
+ * a yaml::Node tree. Fields missing from the file are left untouched and unknown fields are skipped
+ */
+template<typename _T>
+bool load(std::FILE* file, _T& obj)
+{
+    static_assert(Fields<_T>().supported(), "YAML ASSERT: type must be declared with YAML_FIELDS");
+
+    Reader reader = Reader(file);
+    detail::read_fields(reader, obj, 0);
+    return reader.get_status() == ParseStatus::Success;
+}
+
+template<typename _T>
+bool load(const std::string& filename, _T& obj)
+{
+    std::FILE* file = std::fopen(filename.c_str(), "r");
+    if (file != nullptr)
+    {
+        bool result = load(file, obj);
+        std::fclose(file);
+        return result;
+    }
+    return false;
+}
+
+/**
+ * @brief Serializes a struct declared with YAML_FIELDS straight into the file, without building a
+ * yaml::Node tree
+ */
+template<typename _T>
+bool save(const _T& obj, std::FILE* file)
+{
+    static_assert(Fields<_T>().supported(), "YAML ASSERT: type must be declared with YAML_FIELDS");
+
+    detail::write_fields(file, obj, 0);
+    return std::ferror(file) == 0;
+}
+
+template<typename _T>
+bool save(const _T& obj, const std::string& filename)
+{
+    std::FILE* file = std::fopen(filename.c_str(), "w");
+    if (file == nullptr)
+        return false;
+
+    bool result = save(obj, file);
+    std::fclose(file);
+    return result;
+}
+
+template<typename _T>
+std::string get_fields_as_string(const _T& obj)
+{
+    static_assert(Fields<_T>().supported(), "YAML ASSERT: type must be declared with YAML_FIELDS");
+
+    std::string str = {};
+    detail::write_fields(str, obj, 0);
+    return str;
+}
+
 } // namespace yaml
 
+// clang-format off
+#define _YAML_MEMBER(field) &Type::field
+#define _YAML_NAME(field) std::string_view(#field)
+
+#define _YAML_FOR_EACH_1(m, a) m(a)
+#define _YAML_FOR_EACH_2(m, a, ...) m(a), _YAML_FOR_EACH_1(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_3(m, a, ...) m(a), _YAML_FOR_EACH_2(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_4(m, a, ...) m(a), _YAML_FOR_EACH_3(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_5(m, a, ...) m(a), _YAML_FOR_EACH_4(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_6(m, a, ...) m(a), _YAML_FOR_EACH_5(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_7(m, a, ...) m(a), _YAML_FOR_EACH_6(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_8(m, a, ...) m(a), _YAML_FOR_EACH_7(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_9(m, a, ...) m(a), _YAML_FOR_EACH_8(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_10(m, a, ...) m(a), _YAML_FOR_EACH_9(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_11(m, a, ...) m(a), _YAML_FOR_EACH_10(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_12(m, a, ...) m(a), _YAML_FOR_EACH_11(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_13(m, a, ...) m(a), _YAML_FOR_EACH_12(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_14(m, a, ...) m(a), _YAML_FOR_EACH_13(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_15(m, a, ...) m(a), _YAML_FOR_EACH_14(m, __VA_ARGS__)
+#define _YAML_FOR_EACH_16(m, a, ...) m(a), _YAML_FOR_EACH_15(m, __VA_ARGS__)
+
+#define _YAML_GET_FOR_EACH(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, \
+                           name, ...) name
+#define _YAML_FOR_EACH(m, ...)                                                                     \
+    _YAML_GET_FOR_EACH(__VA_ARGS__, _YAML_FOR_EACH_16, _YAML_FOR_EACH_15, _YAML_FOR_EACH_14,       \
+                       _YAML_FOR_EACH_13, _YAML_FOR_EACH_12, _YAML_FOR_EACH_11, _YAML_FOR_EACH_10, \
+                       _YAML_FOR_EACH_9, _YAML_FOR_EACH_8, _YAML_FOR_EACH_7, _YAML_FOR_EACH_6,     \
+                       _YAML_FOR_EACH_5, _YAML_FOR_EACH_4, _YAML_FOR_EACH_3, _YAML_FOR_EACH_2,     \
+                       _YAML_FOR_EACH_1)(m, __VA_ARGS__)
+// clang-format on
+
+/**
+ * @brief Declares the fields of a struct so it can be used with yaml::load() and yaml::save().
+ * Must be used in the global namespace, supports up to 16 fields. Field types need either a
+ * yaml::Convert<_T> implementation or their own YAML_FIELDS declaration
+ *
+ * YAML_FIELDS(Transform, translation, rotation, scale)
+ */
+#define YAML_FIELDS(type, ...)                                                                     \
+    template<>                                                                                     \
+    struct yaml::Fields<type>                                                                      \
+    {                                                                                              \
+        using Type = type;                                                                         \
+        constexpr bool supported() const { return true; }                                          \
+        static constexpr auto members =                                                            \
+            std::make_tuple(_YAML_FOR_EACH(_YAML_MEMBER, __VA_ARGS__));                            \
+        static constexpr yaml::detail::KeyTable<std::tuple_size_v<decltype(members)>> keys =      \
+            std::array{_YAML_FOR_EACH(_YAML_NAME, __VA_ARGS__)};                                   \
+    };
+
 #endif